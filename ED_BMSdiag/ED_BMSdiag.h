@@ -28,7 +28,7 @@
 #define HELP 1                   //!< HELP menu active
 #define ECHO 1                   //!< local ECHO of CLI
 #define NLG6TEST 1               //!< Test if the NLG6 fast charger is installed, 
-                                 //!< set zero to speed up startup with standard OBL!!!
+                                 //!< only done if the charger answered the discovery
 
 #include <mcp_can.h>
 #include <Timeout.h>
@@ -41,6 +41,7 @@ char* const PROGMEM version = (char *) "1.0.8b";
 #define ALL_OK F("* All measurements captured *")
 #define MSG_OK F("OK")
 #define MSG_FAIL F("F")
+#define MSG_NRC F("N")
 #define MSG_DOT F(".")
 
 #define CS     10                //!< chip select pin of MCP2515 CAN-Controller
@@ -52,10 +53,15 @@ BatteryDiag_t BMS;
 ChargerDiag_t NLG6;
 CoolingSub_t CLS;
 
-CTimeout CAN_Timeout(5000);     //!< Timeout value for CAN response in millis
+#define CAN_TIMEOUT 5000         //!< Timeout value for CAN response in millis
+#define FC_PROBE_TIMEOUT 500     //!< Timeout value for CAN response while calibrating flow control
+
+CTimeout CAN_Timeout(CAN_TIMEOUT); //!< Timeout for CAN response
 CTimeout CLI_Timeout(500);      //!< Timeout value for CLI polling in millis
 CTimeout LOG_Timeout(30000);    //!< Timeout value for LOG activity in millis
 
+#define AGE_SESSION 0xFF         //!< max. age: values are kept while running
+
 //Menu levels
 typedef enum {MAIN, subBMS, subNLG6, subOBL, subCS} submenu_t;
 
@@ -67,11 +73,115 @@ typedef struct {
   uint16_t logCount = 0;
   bool initialDump = true;
   bool experimental = false;
+  bool partial = true;           //!< keep reading after a failed step
+  byte maxAge = AGE_SESSION;     //!< limit of kMaxAge in s, 0 := always read
+  bool background = false;       //!< keep sniffing BMS broadcast values while idle
+  byte ECUs = (1 << ECU_COUNT) - 1; //!< bit per ECU found at startup (ECU_t)
 } deviceStatus_t;
 
 deviceStatus_t myDevice;
 
-enum {EE_Signature = 0, EE_InitialDumpAll, EE_logging, EE_logInterval, EE_Experimental};
+#define BMS_STEPS 12             //!< diagnostic steps of getBMSdata
+#define BMS_ALL 0x0FFF           //!< all steps of getBMSdata
+#define NLG6_STEPS 4             //!< diagnostic steps of getNLG6data
+#define NLG6_ALL 0x0F            //!< all steps of getNLG6data
+
+//Result of the last readout per diagnostic step
+typedef struct {
+  uint16_t BMSfailed = 0;        //!< bit per BMS step, set if not obtained
+  byte NLG6failed = 0;           //!< bit per NLG6 step, set if not obtained
+  uint16_t BMStime[BMS_STEPS];   //!< latency per BMS step in ms
+  uint16_t NLG6time[NLG6_STEPS]; //!< latency per NLG6 step in ms
+} readoutStatus_t;
+
+readoutStatus_t myReadout;
+
+//Freshness of the values read by a step: sniffed from the bus, requested or cached
+typedef enum {SRC_NONE = 0, SRC_SNIFF, SRC_UDS, SRC_CACHE} dataSource_t;
+
+#define SNIFF_STEPS SNIFF_FIELDS //!< steps of ReadCANtraffic_BMS
+typedef enum {FRESH_SNIFF = 0, FRESH_BMS = FRESH_SNIFF + SNIFF_STEPS, FRESH_NLG6 = FRESH_BMS + BMS_STEPS,
+              FRESH_CLS = FRESH_NLG6 + NLG6_STEPS, FRESH_COUNT} freshGroup_t;
+
+typedef struct {
+  uint16_t time;                 //!< s since startup when read
+  byte source;                   //!< dataSource_t
+} freshness_t;
+
+freshness_t myFresh[FRESH_COUNT];
+
+//Max. age in s of the values of each step to be used again. Cell voltages 
+//and capacities (BMS #0, #1) are not kept after output and always read.
+const PROGMEM byte kMaxAge[FRESH_COUNT] = {
+  5, 5, 5, 5, 5, 5, 5, 60,                                  // sniffed: SOC ... time
+  0, 0, 5, 60, 0, 10, AGE_SESSION, AGE_SESSION, 30, 60, 5, 30, // BMS steps
+  5, 5, 5, 30,                                              // NLG6 steps
+  10                                                        // cooling & subsystems
+};
+
+enum {EE_Signature = 0, EE_InitialDumpAll, EE_logging, EE_logInterval, EE_Experimental,
+      EE_FlowControl,            //!< block size and STmin per ECU, STmin 0xFF := not calibrated
+      EE_Partial = EE_FlowControl + 2 * ECU_COUNT, EE_MaxAge, EE_Background};
 const byte kMagicSignature = 0x55;
 
+#define EE_Cache 32              //!< start of the identity cache in EEPROM
+#define SWREV_SIZE 96            //!< maximum length of cached NLG6 SW revisions
+
+//Groups of static identity data kept in the cache
+typedef enum {ID_BATT_DATE = 0, ID_BATT_REV, ID_NLG6_PN, ID_NLG6_SW, ID_COUNT} identityGroup_t;
+
+//Static identity data of the ECUs, kept in EEPROM for the battery VIN
+typedef struct {
+  byte signature;                //!< kMagicSignature if initialized
+  char VIN[17];                  //!< battery VIN the data belongs to
+  byte valid;                    //!< bit per identityGroup_t
+  uint16_t time[ID_COUNT];       //!< ms used by the requests of each group
+  byte BattDate[6];              //!< FAT date and production date (Y/M/D)
+  byte BattRev[6];               //!< HW and SW revision (Y/WK/PL)
+  byte NLG6present;
+  char PN_HW[10];                //!< charger part number
+  byte SWrevLength;
+  byte SWrev[SWREV_SIZE];        //!< charger SW revisions (ASCII)
+} identityCache_t;
+
+const PROGMEM byte kCacheRequests[ID_COUNT] = {2, 2, 1, 1}; //!< requests per group
+
+//Statistics of the identity cache
+typedef struct {
+  bool active = false;           //!< battery VIN read, cache usable
+  uint16_t requests = 0;         //!< requests skipped since startup
+  unsigned long time = 0;        //!< ms skipped since startup
+} cacheStatus_t;
+
+cacheStatus_t myCache;
+
+#define MON_BITRATE 500000       //!< bit rate of the car's CAN bus
+
+//Statistics of one CAN ID seen by the bus monitor
+typedef struct {
+  uint16_t ID;
+  uint16_t count;                //!< frames received
+  uint16_t last;                 //!< millis() of the last frame, low 16 bits
+  uint16_t minGap;               //!< shortest inter-arrival time in ms
+  uint16_t maxGap;               //!< longest inter-arrival time in ms
+  uint16_t meanGap;              //!< running mean of the inter-arrival time in ms
+  byte len;                      //!< last DLC
+  byte hash;                     //!< hash of the last payload
+} monitorID_t;
+
+#define MON_IDS (DATALENGTH / sizeof(monitorID_t)) //!< CAN IDs tracked, table shares the response buffer
+
+//Bus monitor, table sorted by ID in the diagnostic response buffer while running
+typedef struct {
+  bool active = false;
+  byte IDs = 0;                  //!< used entries of table
+  monitorID_t *table = NULL;     //!< lent by DiagCAN
+  uint16_t from = 0;             //!< lowest ID tracked
+  uint16_t dropped = 0;          //!< frames of IDs not tracked
+  unsigned long bits = 0;        //!< estimated bits on the bus
+  unsigned long start = 0;       //!< millis() of start
+} monitor_t;
+
+monitor_t myMonitor;
+
 void ReadGlobalConfig(deviceStatus_t *config, bool force_write = false);
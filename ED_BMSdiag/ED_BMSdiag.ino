@@ -56,11 +56,12 @@ void setup() {
   // Initialize MCP2515 and clear filters
   DiagCAN.begin(&CAN0, &CAN_Timeout);
   DiagCAN.clearCAN_Filter();
+  DiagCAN.setIdleCallback(diagIdle);
 
   digitalWrite(CS, HIGH);
 
-  // MCP2515 read buffer: setting pin 2 for input, LOW if CAN messages are received
-  pinMode(2, INPUT);
+  // MCP2515 INT on pin 2 goes LOW if CAN messages are received, an ISR moves them to the receive ring
+  CAN0.enableRxInterrupt(2);
 
   //Serial.println(getFreeRam());
 
@@ -68,16 +69,23 @@ void setup() {
   printWelcomeScreen();
   delay(1000);
 
-  //Look if a NLG6 fastcharger is installed
-  if (NLG6TEST) nlg6_installed();
+  //Find the ECUs answering, missing ones are left out of menus and requests
+  discover_ECUs();
+
+  //test valid VIN stored in battery, static data of this car is cached
+  if (ECUpresent(ECU_BMS)) test_BattVIN();
+  openIdentityCache();
 
-  //test valid VIN stored in battery
-  test_BattVIN();
+  //Look if a NLG6 fastcharger is installed
+  if (NLG6TEST && ECUpresent(ECU_NLG6)) nlg6_installed();
   
   //Read CAN-Bus IDs related to BMS (sniff traffic)
   byte selected[] = {0,1,2,3,4,5,6,7};
   ReadCANtraffic_BMS(selected, sizeof(selected));
 
+  //Keep the broadcast values up to date while idle
+  if (myDevice.background) DiagCAN.setBackground(&BMS);
+
   //Setup CLI, display prompt and local echo
   setupMenu();
   init_cmd_prompt();
@@ -86,6 +94,7 @@ void setup() {
   // Do this after the setupMenu() call.
   if (myDevice.initialDump)
     get_all(0, (char**) 0L);
+  printCacheStatus();
 
   //Print standard data set as overview
   printSplashScreen();
@@ -103,9 +112,14 @@ void loop() {
    if (CLI_Timeout.Expired(true)) {
       cmdPoll();                                   //Poll CLI status
    }
-   if (myDevice.logging && LOG_Timeout.Expired(true)){
+   if (myDevice.logging && !myMonitor.active && LOG_Timeout.Expired(true)){
       logdata();
    }
+   if (myMonitor.active) {
+      pollMonitor();                               //Count all frames on the bus
+   } else {
+      DiagCAN.background();                        //Decode broadcast values, if enabled
+   }
 }
 
 //--------------------------------------------------------------------------------
@@ -134,140 +148,227 @@ void clearSerialBuffer() {
   } while (Serial.read() >= 0);
 }
 
+//--------------------------------------------------------------------------------
+//! \brief   Keep CLI responsive while waiting for diagnostic responses.
+//! \brief   Input is buffered and executed after the running command, 
+//! \brief   broadcast values are decoded by the background sniffer. A due log
+//! \brief   tick waits for the main loop, its requests can't be nested.
+//--------------------------------------------------------------------------------
+void diagIdle() {
+  if (CLI_Timeout.Expired(true)) {
+    cmdBuffer();
+  }
+  DiagCAN.background();
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Check if an ECU answered the discovery at startup
+//! \param   ECU index (ECU_t)
+//! \return  ECU present (boolean)
+//--------------------------------------------------------------------------------
+boolean ECUpresent(byte ecu) {
+  return bitRead(myDevice.ECUs, ecu);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Check if the values of a step were read recently enough to be 
+//! \brief   used again, see kMaxAge. Logging always reads new values.
+//! \param   group (freshGroup_t)
+//! \return  values fresh (boolean)
+//--------------------------------------------------------------------------------
+boolean isFresh(byte group) {
+  if (myDevice.logging || myFresh[group].source == SRC_NONE) return false;
+  byte maxAge = min(pgm_read_byte(&kMaxAge[group]), myDevice.maxAge);
+  if (maxAge == 0) return false;
+  uint16_t age = (uint16_t) (millis() / 1000) - myFresh[group].time;
+  return (maxAge == AGE_SESSION || age <= maxAge);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Remember time and source of values just read
+//! \param   group (freshGroup_t), source (dataSource_t)
+//--------------------------------------------------------------------------------
+void setFresh(byte group, byte source) {
+  myFresh[group].time = millis() / 1000;
+  myFresh[group].source = source;
+}
 
 //--------------------------------------------------------------------------------
 //! \brief   Read CAN-Bus traffic for BMS relevant data
 //! \param   selected items for task (byte array), length of array
 //--------------------------------------------------------------------------------
 void ReadCANtraffic_BMS(byte *selected, byte len) {
-  boolean fOK = false;
+  byte wanted = 0;
+  byte obtained = 0;
+  byte testStep;
+
+  //The bus monitor owns filters and frames
+  if (myMonitor.active) {
+    Serial.println(F("Bus monitor running, stop it by mon off"));
+    return;
+  }
 
-  //Read CAN-messages
-  byte testStep = 0;
-  do {
-    switch (selected[testStep]) {
-      case 0:
-         fOK = DiagCAN.ReadSOC(&BMS);
-         break;
-      case 1:
-         fOK = DiagCAN.ReadSOCinternal(&BMS);
-         break;
-      /*case 2:
-         //fOK = DiagCAN.getBatteryAmps(&BMS, false);
-         fOK = DiagCAN.ReadAmps(&BMS);
-         break;
-      case 3:
-         fOK = DiagCAN.ReadHV(&BMS);
-         break;*/
-      case 4: 
-         fOK = DiagCAN.ReadPower(&BMS);
-         break;
-      case 5:
-         fOK = DiagCAN.ReadLV(&BMS);
-         break;
-      case 6:
-         fOK = DiagCAN.ReadODO(&BMS);
-         break;
-      case 7:
-         fOK = DiagCAN.ReadTime(&BMS);
-         break;
+  //Values still fresh or kept current by the background sniffer are not read again
+  for (testStep = 0; testStep < len; testStep++) {
+    if (myDevice.background && !DiagCAN.isStale(selected[testStep])) {
+      setFresh(FRESH_SNIFF + selected[testStep], SRC_SNIFF);
     }
-    if (!myDevice.logging && testStep < 8) {
-      if (fOK) {
+    if (isFresh(FRESH_SNIFF + selected[testStep])) {
+      bitSet(obtained, selected[testStep]);
+    } else {
+      bitSet(wanted, selected[testStep]);
+    }
+  }
+
+  //Read CAN-messages, all wanted values in one pass
+  if (wanted) {
+    byte seen = DiagCAN.SniffBMS(&BMS, wanted);
+    for (testStep = 0; testStep < SNIFF_STEPS; testStep++) {
+      if (bitRead(seen, testStep)) setFresh(FRESH_SNIFF + testStep, SRC_SNIFF);
+    }
+    obtained |= seen;
+  }
+  
+  if (!myDevice.logging) {
+    for (testStep = 0; testStep < len; testStep++) {
+      if (bitRead(obtained, selected[testStep])) {
         Serial.print(MSG_DOT);
       } else {
         Serial.print(MSG_FAIL);Serial.print(F("#")); Serial.print(selected[testStep]);
       }
     }
-    testStep++;
-  } while (testStep < len);
+  }
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Get BMS datasets
+//! \brief   Get BMS datasets. In partial mode all selected steps are read,
+//! \brief   failed steps are kept in myReadout for the "retry" command.
 //! \param   selected items for task (byte array), length of array
+//! \return  all selected steps obtained (boolean)
 //--------------------------------------------------------------------------------
 boolean getBMSdata(byte *selected, byte len) {
   boolean fOK = false;
+  boolean fAll = true;
+  unsigned long tStart;
   
   //Get diagnostics data
   DiagCAN.setCAN_ID(0x7E7, 0x7EF);
 
+  //Steps not reached count as failed
+  for (byte i = 0; i < len; i++) {
+    bitSet(myReadout.BMSfailed, selected[i]);
+  }
+
   byte testStep = 0;
   do {
-    switch (selected[testStep]) {
-      case 0:
-         fOK = DiagCAN.getBatteryVoltage(&BMS, false);
-         break;
-      case 1:
-         fOK = DiagCAN.getBatteryCapacity(&BMS, false);
-         break;
-      case 2:
-         fOK = DiagCAN.getBatteryAmps(&BMS, false);
-         break;
-      case 3:
-         fOK = DiagCAN.getBatteryExperimentalData(&BMS, false);
-         break;
-      case 5:
-         fOK = DiagCAN.getBatteryADCref(&BMS, false);
-         break;
-      case 6:
-         fOK = DiagCAN.getBatteryDate(&BMS, false);
-         break;
-      case 7:
-         fOK = DiagCAN.getBatteryRevision(&BMS, false);
-         break;
-      case 8:
-         fOK = DiagCAN.getBatteryTemperature(&BMS, false);
-         break;
-      case 9:
-         fOK = DiagCAN.getHVcontactorState(&BMS, false);
-         break;
-      case 10:
-         fOK = DiagCAN.getHVstatus(&BMS, false);
-         break;
-      case 11:
-         fOK = DiagCAN.getIsolationValue(&BMS, false);
-         break;
+    tStart = millis();
+    uint16_t cached = myCache.requests;
+    if (isFresh(FRESH_BMS + selected[testStep])) {
+      fOK = true;
+    } else {
+      switch (selected[testStep]) {
+        case 0:
+           fOK = DiagCAN.getBatteryVoltage(&BMS, false);
+           break;
+        case 1:
+           fOK = DiagCAN.getBatteryCapacity(&BMS, false);
+           break;
+        case 2:
+           fOK = DiagCAN.getBatteryAmps(&BMS, false);
+           break;
+        case 3:
+           fOK = DiagCAN.getBatteryExperimentalData(&BMS, false);
+           break;
+        case 5:
+           fOK = DiagCAN.getBatteryADCref(&BMS, false);
+           break;
+        case 6:
+           fOK = getBatteryDateCached();
+           break;
+        case 7:
+           fOK = getBatteryRevisionCached();
+           break;
+        case 8:
+           fOK = DiagCAN.getBatteryTemperature(&BMS, false);
+           break;
+        case 9:
+           fOK = DiagCAN.getHVcontactorState(&BMS, false);
+           break;
+        case 10:
+           fOK = DiagCAN.getHVstatus(&BMS, false);
+           break;
+        case 11:
+           fOK = DiagCAN.getIsolationValue(&BMS, false);
+           break;
+      }
+      if (fOK) setFresh(FRESH_BMS + selected[testStep], (myCache.requests != cached) ? SRC_CACHE : SRC_UDS);
     }
+    myReadout.BMStime[selected[testStep]] = millis() - tStart;
     if (!myDevice.logging && testStep < 12) {
       if (fOK) {
         Serial.print(MSG_DOT);
+      } else if (DiagCAN.NRCreceived()) {
+        Serial.print(MSG_NRC);Serial.print(F("#")); Serial.print(selected[testStep]);
       } else {
         Serial.print(MSG_FAIL);Serial.print(F("#")); Serial.print(selected[testStep]);
       }
     }
+    //DID not supported by this ECU: keep the NRC and go on with the next step
+    if (!fOK && DiagCAN.NRCreceived()) {
+      fOK = true;
+    }
+    if (fOK) {
+      bitClear(myReadout.BMSfailed, selected[testStep]);
+    } else {
+      fAll = false;
+    }
     testStep++;
-  } while (fOK && testStep < len);
+  } while ((fOK || myDevice.partial) && testStep < len);
   
-  return fOK;
+  return fAll;
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Get NLG6 datasets
+//! \brief   Get NLG6 datasets, see #getBMSdata for partial mode
+//! \param   selected steps (bit per step), NLG6_ALL for all
+//! \return  all selected steps obtained (boolean)
 //--------------------------------------------------------------------------------
-boolean getNLG6data() {
-  boolean fOK = false;
+boolean getNLG6data(byte steps) {
+  boolean fOK = true;
+  boolean fAll = true;
+  unsigned long tStart;
   
   //Get diagnostics data
   DiagCAN.setCAN_ID(0x61A, 0x483);
+  myReadout.NLG6failed |= steps;
 
   byte testStep = 0;
   do {
-    switch (testStep) {
-      case 0:
-         fOK = DiagCAN.getChargerVoltages(&NLG6, false);
-         break;
-      case 1:
-         fOK = DiagCAN.getChargerAmps(&NLG6, false);
-         break;
-      case 2:
-         fOK = DiagCAN.getChargerSelCurrent(&NLG6, false);
-         break;
-      case 3:
-         fOK = DiagCAN.getChargerTemperature(&NLG6, false);
-         break;
+    if (!bitRead(steps, testStep)) {
+      testStep++;
+      continue;
+    }
+    tStart = millis();
+    if (isFresh(FRESH_NLG6 + testStep)) {
+      fOK = true;
+    } else {
+      switch (testStep) {
+        case 0:
+           fOK = DiagCAN.getChargerVoltages(&NLG6, false);
+           break;
+        case 1:
+           fOK = DiagCAN.getChargerAmps(&NLG6, false);
+           break;
+        case 2:
+           fOK = DiagCAN.getChargerSelCurrent(&NLG6, false);
+           break;
+        case 3:
+           fOK = DiagCAN.getChargerTemperature(&NLG6, false);
+           break;
+      }
+      if (fOK) setFresh(FRESH_NLG6 + testStep, SRC_UDS);
     }
+    myReadout.NLG6time[testStep] = millis() - tStart;
     if (!myDevice.logging && testStep < 4) {
       if (fOK) {
         Serial.print(MSG_DOT);
@@ -275,10 +376,15 @@ boolean getNLG6data() {
         Serial.print(MSG_FAIL);Serial.print(F("#")); Serial.print(testStep);
       }
     }
+    if (fOK) {
+      bitClear(myReadout.NLG6failed, testStep);
+    } else {
+      fAll = false;
+    }
     testStep++;
-  } while (fOK && testStep < 4);
+  } while ((fOK || myDevice.partial) && testStep < NLG6_STEPS);
   
-  return fOK;
+  return fAll;
 }
 
 //--------------------------------------------------------------------------------
@@ -290,11 +396,19 @@ boolean getCLSdata() {
   //Get diagnostics data
   DiagCAN.setCAN_ID(0x7E5, 0x7ED);
 
-  fOK = DiagCAN.getCoolingAndSubsystems(&CLS, false);   
+  uint16_t NRCs = DiagCAN.getNRCcount();
+  if (isFresh(FRESH_CLS)) {
+    fOK = true;
+  } else {
+    fOK = DiagCAN.getCoolingAndSubsystems(&CLS, false);   
+    if (fOK) setFresh(FRESH_CLS, SRC_UDS);
+  }
 
   if (!myDevice.logging) {
-    if (fOK) {
+    if (fOK && NRCs == DiagCAN.getNRCcount()) {
       Serial.print(MSG_DOT);
+    } else if (fOK) {
+      Serial.print(MSG_NRC);Serial.print(F("#0"));
     } else {
       Serial.print(MSG_FAIL);Serial.print(F("#0"));
     }
@@ -313,10 +427,31 @@ void ReadGlobalConfig(deviceStatus_t *config, bool force_write)
     EEPROM.update(EE_logging, 0);
     EEPROM.update(EE_logInterval, 30);
     EEPROM.update(EE_Experimental, 0);
+    EEPROM.update(EE_Partial, 1);
+    EEPROM.update(EE_MaxAge, AGE_SESSION);
+    EEPROM.update(EE_Background, 0);
+    for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+      EEPROM.update(EE_FlowControl + 2 * ecu, FC_BS_DEFAULT);
+      EEPROM.update(EE_FlowControl + 2 * ecu + 1, 0xFF);
+    }
+    invalidateIdentityCache();
     EEPROM.update(EE_Signature, kMagicSignature);
   }
   config->initialDump = (EEPROM.read(EE_InitialDumpAll) > 0);
   config->logging = (EEPROM.read(EE_logging) > 0);
   config->timer = EEPROM.read(EE_logInterval);
   config->experimental = (EEPROM.read(EE_Experimental) > 0);
+  config->partial = (EEPROM.read(EE_Partial) > 0);
+  config->maxAge = EEPROM.read(EE_MaxAge);
+  config->background = (EEPROM.read(EE_Background) == 1);
+
+  // Flow control profiles found by the "fc" calibration
+  for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+    byte STmin = EEPROM.read(EE_FlowControl + 2 * ecu + 1);
+    if (STmin != 0xFF) {
+      DiagCAN.setFlowControl(ecu, EEPROM.read(EE_FlowControl + 2 * ecu), STmin);
+    } else {
+      DiagCAN.setFlowControl(ecu, FC_BS_DEFAULT, FC_STMIN_DEFAULT);
+    }
+  }
 }
@@ -37,11 +37,15 @@ void setupMenu() {
   cmdAdd("t", get_temperatures);
   cmdAdd("v", get_voltages);
   cmdAdd("bms", bms_sub);
-  cmdAdd("cs", cs_sub);
-  if (NLG6.NLG6present) {
-    cmdAdd("nlg6", nlg6_sub);
-  } else {
-    cmdAdd("obl", obl_sub);
+  if (ECUpresent(ECU_CLS)) {
+    cmdAdd("cs", cs_sub);
+  }
+  if (ECUpresent(ECU_NLG6)) {
+    if (NLG6.NLG6present) {
+      cmdAdd("nlg6", nlg6_sub);
+    } else {
+      cmdAdd("obl", obl_sub);
+    }
   }
   cmdAdd("all", get_all);
   cmdAdd("rpt", get_rpt);
@@ -50,6 +54,14 @@ void setupMenu() {
   cmdAdd("reset", reset_factory_defaults);
   cmdAdd("initial", set_initial_dump);
   cmdAdd("experimental", set_experimental);
+  cmdAdd("fc", calibrate_fc);
+  cmdAdd("partial", set_partial);
+  cmdAdd("retry", retry_failed);
+  cmdAdd("cache", set_cache);
+  cmdAdd("age", set_max_age);
+  cmdAdd("canstat", show_canstat);
+  cmdAdd("bg", set_background);
+  cmdAdd("mon", set_monitor);
 }
 
 //--------------------------------------------------------------------------------
@@ -70,12 +82,16 @@ void get_all (uint8_t arg_cnt, char **args) {
       printCLSall();
       break;
     case MAIN:
+      //Charger and cooling data are requested in the background while reading the BMS
+      if (ECUpresent(ECU_NLG6)) DiagCAN.queueRequests(ECU_NLG6);
+      if (ECUpresent(ECU_CLS)) DiagCAN.queueRequests(ECU_CLS);
       printBMSall();
-      printNLG6all();
-      printCLSall();
+      if (ECUpresent(ECU_NLG6)) printNLG6all();
+      if (ECUpresent(ECU_CLS)) printCLSall();
+      DiagCAN.clearQueue();
       break;
   }
-  if (g_failure == 0) {
+  if (g_failure == 0 && myReadout.BMSfailed == 0 && myReadout.NLG6failed == 0) {
     Serial.println();
     Serial.println(ALL_OK);
   }
@@ -96,15 +112,18 @@ void get_rpt (uint8_t arg_cnt, char **args) {
 //--------------------------------------------------------------------------------
 void get_temperatures (uint8_t arg_cnt, char **args) {
   (void) arg_cnt, (void) args;  // avoid -Wunusedparameter warning
+  byte selected[] = {8};
   switch (myDevice.menu) {
     case subBMS:
-      if (DiagCAN.getBatteryTemperature(&BMS, false)){
+      if (getBMSdata(selected, sizeof(selected))){
+        Serial.println();
         printBMStemperatures();
       }
       break;
     case subNLG6:
     case subOBL:
-      if (DiagCAN.getChargerTemperature(&NLG6, false)){
+      if (getNLG6data(bit(3))){
+        Serial.println();
         printNLG6temperatures();
       }
       break;
@@ -121,15 +140,17 @@ void get_temperatures (uint8_t arg_cnt, char **args) {
 //--------------------------------------------------------------------------------
 void get_voltages (uint8_t arg_cnt, char **args) {
   (void) arg_cnt, (void) args;  // avoid -Wunusedparameter warning
+  byte selected[] = {5};
   switch (myDevice.menu) {
     case subBMS:
-      if (DiagCAN.getBatteryADCref(&BMS, false)){
+      if (getBMSdata(selected, sizeof(selected))){
+        Serial.println();
         printBMS_CellVoltages();
       }
       break;
     case subNLG6:
     case subOBL:
-      if (getNLG6data()){
+      if (getNLG6data(NLG6_ALL)){
         Serial.println();
         printNLG6_Status();
       }
@@ -153,11 +174,15 @@ void help(uint8_t arg_cnt, char **args)
     case MAIN:
       Serial.println(F("* Main Menu:"));
       Serial.println(F("  BMS          Submenu"));
-      Serial.println(F("  CS           Submenu"));
-      if (NLG6.NLG6present) {
-        Serial.println(F("  NLG6         Submenu"));
-      } else {
-        Serial.println(F("  OBL          Submenu"));
+      if (ECUpresent(ECU_CLS)) {
+        Serial.println(F("  CS           Submenu"));
+      }
+      if (ECUpresent(ECU_NLG6)) {
+        if (NLG6.NLG6present) {
+          Serial.println(F("  NLG6         Submenu"));
+        } else {
+          Serial.println(F("  OBL          Submenu"));
+        }
       }
       Serial.println(F("  all          Run all tests"));
       Serial.println(F("  rpt          Show battery report"));
@@ -171,6 +196,19 @@ void help(uint8_t arg_cnt, char **args)
       Serial.println(F("               [on/off]"));
       Serial.println(F("  experimental Configure whether to include experimental data"));
       Serial.println(F("               [on/off]"));
+      Serial.println(F("  fc           Calibrate flow control of all ECUs"));
+      Serial.println(F("  partial      Keep reading after a failed step"));
+      Serial.println(F("               [on/off]"));
+      Serial.println(F("  retry        Read failed steps of the last run again"));
+      Serial.println(F("  cache        Show identity cache, [clear] to drop it"));
+      Serial.println(F("  age          Limit age of reused values"));
+      Serial.println(F("               [time/s], 0 := always read"));
+      Serial.println(F("  canstat      Show CAN receive and error counters, [clear] to reset"));
+      Serial.println(F("  bg           Keep BMS broadcast values current while idle"));
+      Serial.println(F("               [on/off], without argument show value ages"));
+      Serial.println(F("  mon          Monitor all CAN IDs, rates and bus load"));
+      Serial.println(F("               [on [ID]/off/clear], without argument show summary"));
+      Serial.println(F("               diagnostic requests fail while it runs"));
             
       Serial.println();
       Serial.println(F("  #     Show real time data"));
@@ -234,7 +272,7 @@ void print_on_off(bool on)
 void show_info(uint8_t arg_cnt, char **args)
 {
   (void) arg_cnt, (void) args;  // avoid -Wunusedparameter warning
-  //Serial.print(F("Usable Memory: ")); Serial.println(getFreeRam());
+  Serial.print(F("Usable Memory: ")); Serial.println(getFreeRam());
   //Serial.print(F("Menu: ")); Serial.println(myDevice.menu);
 //  Serial.print(F("    Car VIN: ")); Serial.println(BMS.CarVIN);
   Serial.print(F("Battery VIN: ")); Serial.println(BMS.BattVIN);
@@ -247,6 +285,32 @@ void show_info(uint8_t arg_cnt, char **args)
   print_on_off (myDevice.initialDump);
   Serial.print(F("Experimental data is "));
   print_on_off (myDevice.experimental);
+  Serial.print(F("Partial results are "));
+  print_on_off (myDevice.partial);
+  Serial.print(F("Background sniffing is "));
+  print_on_off (myDevice.background);
+  printReadoutStatus();
+  printCacheStatus();
+  printFreshness();
+  Serial.print(F("Flow control BS/STmin: "));
+  for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+    FlowControl_t FC = DiagCAN.getFlowControl(ecu);
+    print_ECU(ecu); Serial.print(F(" ")); Serial.print(FC.BS); Serial.print(F("/")); Serial.print(FC.STmin);
+    if (!DiagCAN.DIDbatching(ecu)) Serial.print(F(" (single DID)"));
+    if (ecu < ECU_COUNT - 1) Serial.print(F(", "));
+  }
+  Serial.println();
+  Serial.print(F("Negative responses: ")); Serial.print(DiagCAN.getNRCcount());
+  Serial.print(F(", saved ")); Serial.print(DiagCAN.getNRCsavedTime()); Serial.println(F(" ms"));
+  Serial.print(F("Lost frames: ")); Serial.print(DiagCAN.getSeqErrorCount());
+  Serial.print(F(", retries ")); Serial.print(DiagCAN.getRetryCount());
+  Serial.print(F(", rx overflow ")); Serial.println(CAN0.getRxOverflow());
+  if (DiagCAN.NRCreceived()) {
+    const DiagNRC_t *NRC = DiagCAN.getLastNRC();
+    Serial.print(F("Last NRC: 0x")); Serial.print(NRC->code, HEX);
+    Serial.print(F(", DID 0x")); Serial.print(NRC->DID, HEX);
+    Serial.print(F(", ECU 0x")); Serial.println(NRC->ECU, HEX);
+  }
 }
 
 //--------------------------------------------------------------------------------
@@ -315,6 +379,277 @@ void set_experimental(uint8_t arg_cnt, char **args) {
   }
 }
 
+//--------------------------------------------------------------------------------
+//! \brief   Callback to configure partial results, all steps are read even if 
+//! \brief   one fails
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void set_partial(uint8_t arg_cnt, char **args) {
+  if (arg_cnt > 1) {
+    if (strcmp(args[1], "on") == 0) {
+      myDevice.partial = true;
+    }
+    if (strcmp(args[1], "off") == 0) {
+      myDevice.partial = false;
+    }
+    EEPROM.update(EE_Partial, myDevice.partial);
+  } else {
+    show_info(arg_cnt, args);
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Callback to read only the failed steps of the last run again and
+//! \brief   output the parts of the datasets they belong to
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void retry_failed(uint8_t arg_cnt, char **args) {
+  (void) arg_cnt, (void) args;  // avoid -Wunusedparameter warning
+  if (myReadout.BMSfailed == 0 && myReadout.NLG6failed == 0) {
+    Serial.println(F("Nothing to retry"));
+    return;
+  }
+  if (myReadout.BMSfailed) {
+    byte selected[BMS_STEPS];
+    byte len = 0;
+    uint16_t steps = myReadout.BMSfailed;
+    for (byte i = 0; i < BMS_STEPS; i++) {
+      if (bitRead(steps, i)) selected[len++] = i;
+    }
+    DiagCAN.reserveMem_CellVoltage();
+    DiagCAN.reserveMem_CellCapacity();
+    Serial.print(F("Reading data"));
+    getBMSdata(selected, len);
+    Serial.println();
+    PrintSPACER();
+    printBMSsections(steps & ~myReadout.BMSfailed, false);
+    DiagCAN.freeMem_CellVoltage();
+    DiagCAN.freeMem_CellCapacity();
+  }
+  if (myReadout.NLG6failed) {
+    Serial.print(F("Reading data"));
+    getNLG6data(myReadout.NLG6failed);
+    printNLG6data();
+  }
+  if (myReadout.BMSfailed || myReadout.NLG6failed) {
+    printFailedSteps();
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Callback to limit the age of values used again by the next commands
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void set_max_age(uint8_t arg_cnt, char **args) {
+  if (arg_cnt > 1) {
+    uint32_t age = cmdStr2Num(args[1], 10);
+    myDevice.maxAge = (age < AGE_SESSION) ? age : AGE_SESSION;
+    EEPROM.update(EE_MaxAge, myDevice.maxAge);
+  } else {
+    printFreshness();
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Callback to show or drop the identity cache
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void set_cache(uint8_t arg_cnt, char **args) {
+  if (arg_cnt > 1 && strcmp(args[1], "clear") == 0) {
+    invalidateIdentityCache();
+    openIdentityCache();
+    Serial.println(F("Identity cache cleared"));
+  } else {
+    printCacheStatus();
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Callback to show or reset the receive and error counters of the MCP2515
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void show_canstat(uint8_t arg_cnt, char **args) {
+  if (arg_cnt > 1 && strcmp(args[1], "clear") == 0) {
+    CAN0.clearStats();
+    Serial.println(F("CAN counters cleared"));
+    return;
+  }
+  CAN_STATS stats;
+  CAN0.getStats(stats);
+  Serial.print(F("Frames RXB0/RXB1: ")); Serial.print(stats.rxFrames[0]);
+  Serial.print(F(" / ")); Serial.println(stats.rxFrames[1]);
+  Serial.print(F("Overflows RXB0/RXB1: ")); Serial.print(stats.rxOverflow[0]);
+  Serial.print(F(" / ")); Serial.print(stats.rxOverflow[1]);
+  Serial.print(F(", ring ")); Serial.println(stats.ringOverflow);
+  Serial.print(F("Error passive: ")); Serial.print(stats.errorPassive);
+  Serial.print(F(", bus off ")); Serial.println(stats.busOff);
+  Serial.print(F("TEC: ")); Serial.print(stats.tec); Serial.print(F(" (max ")); Serial.print(stats.tecMax);
+  Serial.print(F("), REC: ")); Serial.print(stats.rec); Serial.print(F(" (max ")); Serial.print(stats.recMax);
+  Serial.println(F(")"));
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Callback to configure background sniffing of the BMS broadcast 
+//! \brief   values, without argument the age and update count of each is shown
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void set_background(uint8_t arg_cnt, char **args) {
+  if (arg_cnt > 1) {
+    if (strcmp(args[1], "on") == 0) {
+      myDevice.background = true;
+    }
+    if (strcmp(args[1], "off") == 0) {
+      myDevice.background = false;
+    }
+    EEPROM.update(EE_Background, myDevice.background);
+    DiagCAN.setBackground(myDevice.background ? &BMS : NULL);
+  }
+  Serial.print(F("Background sniffing is "));
+  print_on_off(myDevice.background);
+  for (byte field = 0; field < SNIFF_FIELDS; field++) {
+    Serial.print(F("  #")); Serial.print(field); Serial.print(F(": "));
+    unsigned long age = DiagCAN.getValueAge(field);
+    if (age == 0xFFFFFFFF) {
+      Serial.print(F("never"));
+    } else {
+      Serial.print(age); Serial.print(F(" ms ago"));
+      if (DiagCAN.isStale(field)) Serial.print(F(", stale"));
+    }
+    Serial.print(F(", updates ")); Serial.println(DiagCAN.getValueUpdates(field));
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Callback to run the bus monitor, without argument the statistics
+//! \brief   collected so far are shown
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void set_monitor(uint8_t arg_cnt, char **args) {
+  if (arg_cnt > 1) {
+    if (strcmp(args[1], "on") == 0) {
+      uint16_t from = (arg_cnt > 2) ? cmdStr2Num(args[2], 16) : 0;
+      if (!startMonitor(from)) Serial.println(F("Monitor needs the response buffer, wait for running requests"));
+    }
+    if (strcmp(args[1], "off") == 0 && myMonitor.active) {
+      printMonitor();
+      stopMonitor();
+    }
+    if (strcmp(args[1], "clear") == 0) {
+      clearMonitor();
+    }
+  } else {
+    printMonitor();
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Find the ECUs on the bus and output them. If none answers, all are 
+//! \brief   assumed to be present.
+//--------------------------------------------------------------------------------
+void discover_ECUs() {
+  unsigned long tStart = millis();
+  byte found = DiagCAN.discoverECUs(DIAG_DISCOVERY_WINDOW);
+  myDevice.ECUs = (found != 0) ? found : (1 << ECU_COUNT) - 1;
+  Serial.print(F("ECUs found: "));
+  if (found == 0) Serial.print(F("none, using all "));
+  for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+    if (bitRead(found, ecu)) {
+      if (ecu == ECU_NLG6) {
+        Serial.print(F("Charger "));          // NLG6 or OBL is checked later
+      } else {
+        print_ECU(ecu); Serial.print(F(" "));
+      }
+    }
+  }
+  Serial.print(F("(")); Serial.print(millis() - tStart); Serial.println(F(" ms)"));
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Output the short name of an ECU
+//! \param   ECU index (ECU_t)
+//--------------------------------------------------------------------------------
+void print_ECU(byte ecu) {
+  switch (ecu) {
+    case ECU_BMS:
+      Serial.print(F("BMS"));
+      break;
+    case ECU_NLG6:
+      if (NLG6.NLG6present) {
+        Serial.print(F("NLG6"));
+      } else {
+        Serial.print(F("OBL"));
+      }
+      break;
+    case ECU_CLS:
+      Serial.print(F("CS"));
+      break;
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Probe a flow control setting twice to make sure no frames are lost
+//! \return  duration of the slower run in ms, 0 if it failed
+//--------------------------------------------------------------------------------
+unsigned long probe_fc(byte ecu, byte BS, byte STmin) {
+  unsigned long t1 = DiagCAN.probeFlowControl(ecu, BS, STmin);
+  if (t1 == 0) return 0;
+  unsigned long t2 = DiagCAN.probeFlowControl(ecu, BS, STmin);
+  if (t2 == 0) return 0;
+  return max(t1, t2);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Callback to find the fastest flow control setting of every ECU:
+//! \brief   smallest STmin first, then the largest block size (0 := unlimited).
+//! \brief   The result is stored to EEPROM and used for all further requests.
+//! \param   Argument count (int) and argument-list (char*) from Cmd.h
+//--------------------------------------------------------------------------------
+void calibrate_fc(uint8_t arg_cnt, char **args) {
+  (void) arg_cnt, (void) args;  // avoid -Wunusedparameter warning
+  const byte STmin[] = {10, 5, 2, 1, 0};
+  const byte BS[] = {0, 32, 16};
+
+  CAN_Timeout.Reset(FC_PROBE_TIMEOUT);   // lost frames must not cost the full timeout
+  for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+    print_ECU(ecu); Serial.print(F(": "));
+    if (!ECUpresent(ecu)) {
+      Serial.println(F("n/a, not found at startup"));
+      continue;
+    }
+    FlowControl_t best = {FC_BS_DEFAULT, FC_STMIN_DEFAULT};
+    unsigned long tDefault = probe_fc(ecu, best.BS, best.STmin);
+    unsigned long tBest = tDefault;
+    if (tDefault == 0) {
+      Serial.println(F("n/a, no multi-frame response"));
+      continue;
+    }
+    for (byte i = 0; i < sizeof(STmin); i++) {
+      unsigned long t = probe_fc(ecu, best.BS, STmin[i]);
+      if (t == 0) break;
+      best.STmin = STmin[i];
+      tBest = t;
+    }
+    for (byte i = 0; i < sizeof(BS); i++) {
+      unsigned long t = probe_fc(ecu, BS[i], best.STmin);
+      if (t > 0) {
+        best.BS = BS[i];
+        tBest = t;
+        break;
+      }
+    }
+    DiagCAN.setFlowControl(ecu, best.BS, best.STmin);
+    EEPROM.update(EE_FlowControl + 2 * ecu, best.BS);
+    EEPROM.update(EE_FlowControl + 2 * ecu + 1, best.STmin);
+
+    Serial.print(F("BS ")); Serial.print(best.BS);
+    Serial.print(F(", STmin ")); Serial.print(best.STmin); Serial.print(F(" ms, "));
+    Serial.print(tDefault); Serial.print(F(" -> ")); Serial.print(tBest); Serial.print(F(" ms"));
+    if (ecu == ECU_BMS) Serial.print(F(" (capacity + voltages)"));
+    Serial.println();
+  }
+  CAN_Timeout.Reset(CAN_TIMEOUT);
+}
+
 void init_cmd_prompt() {
   if (BMS.fHAL == false) {
     set_cmd_display("");            //reset command prompt to "CMD >>" 
@@ -442,7 +777,7 @@ boolean test_BattVIN() {
 //! \return  report status / if present (boolean)
 //--------------------------------------------------------------------------------
 boolean nlg6_installed() {
-  NLG6.NLG6present =  DiagCAN.NLG6ChargerInstalled(&NLG6, false);
+  NLG6.NLG6present =  NLG6ChargerInstalledCached();
   if (NLG6.NLG6present) {
     Serial.println(F("NLG6 detected"));
     PrintSPACER();
@@ -463,8 +798,8 @@ void logdata(){
 
   byte selected2[] ={5,8,11};
   getBMSdata(selected2, sizeof(selected2));
-  getNLG6data();
-  getCLSdata();
+  if (ECUpresent(ECU_NLG6)) getNLG6data(NLG6_ALL);
+  if (ECUpresent(ECU_CLS)) getCLSdata();
 
   if (myDevice.logCount == 0) {
     //Print Header
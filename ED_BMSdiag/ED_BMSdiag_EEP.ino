@@ -0,0 +1,204 @@
+//--------------------------------------------------------------------------------
+// (c) 2015-2018 by MyLab-odyssey
+// (c) 2017-2020 by Jim Sokoloff
+//
+// Licensed under "MIT License (MIT)", see license file for more information.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER OR CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//--------------------------------------------------------------------------------
+//! \file    ED_BMSdiag_EEP.ino
+//! \brief   EEPROM cache of static identity data (dates, revisions, part 
+//! \brief   numbers) of the ECUs, valid for the VIN stored in the battery
+//! \date    2020-April
+//! \author  MyLab-odyssey
+//! \version 1.0.8b
+//--------------------------------------------------------------------------------
+
+#define EE_CACHE(field) (EE_Cache + offsetof(identityCache_t, field))
+
+//--------------------------------------------------------------------------------
+//! \brief   Use the cache for the battery VIN just read, data of another car is 
+//! \brief   dropped
+//! \return  cached data belongs to this car (boolean)
+//--------------------------------------------------------------------------------
+boolean openIdentityCache() {
+  myCache.active = (BMS.BattVIN[0] != 0);
+  if (!myCache.active) return false;
+
+  boolean fMatch = (EEPROM.read(EE_CACHE(signature)) == kMagicSignature);
+  for (byte n = 0; n < 17 && fMatch; n++) {
+    if (EEPROM.read(EE_CACHE(VIN) + n) != (byte) BMS.BattVIN[n]) fMatch = false;
+  }
+  if (!fMatch) {
+    EEPROM.update(EE_CACHE(valid), 0);
+    for (byte n = 0; n < 17; n++) {
+      EEPROM.update(EE_CACHE(VIN) + n, BMS.BattVIN[n]);
+    }
+    EEPROM.update(EE_CACHE(signature), kMagicSignature);
+  }
+  return fMatch;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Drop all cached identity data
+//--------------------------------------------------------------------------------
+void invalidateIdentityCache() {
+  EEPROM.update(EE_CACHE(signature), 0xFF);
+  EEPROM.update(EE_CACHE(valid), 0);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Check for cached data of a group and count the skipped requests
+//! \param   group (identityGroup_t)
+//! \return  data available (boolean)
+//--------------------------------------------------------------------------------
+boolean cacheValid(byte group) {
+  if (!myCache.active || !bitRead(EEPROM.read(EE_CACHE(valid)), group)) return false;
+  uint16_t time;
+  EEPROM.get(EE_CACHE(time) + group * sizeof(uint16_t), time);
+  myCache.requests += pgm_read_byte(&kCacheRequests[group]);
+  myCache.time += time;
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Mark data of a group as cached
+//! \param   group (identityGroup_t), ms used by the requests (uint16_t)
+//--------------------------------------------------------------------------------
+void cacheSetValid(byte group, uint16_t time) {
+  EEPROM.put(EE_CACHE(time) + group * sizeof(uint16_t), time);
+  EEPROM.update(EE_CACHE(valid), EEPROM.read(EE_CACHE(valid)) | bit(group));
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get battery FAT and production date, from cache if available
+//! \return  report success (boolean)
+//--------------------------------------------------------------------------------
+boolean getBatteryDateCached() {
+  if (cacheValid(ID_BATT_DATE)) {
+    BMS.Year = EEPROM.read(EE_CACHE(BattDate));
+    BMS.Month = EEPROM.read(EE_CACHE(BattDate) + 1);
+    BMS.Day = EEPROM.read(EE_CACHE(BattDate) + 2);
+    BMS.ProdYear = EEPROM.read(EE_CACHE(BattDate) + 3);
+    BMS.ProdMonth = EEPROM.read(EE_CACHE(BattDate) + 4);
+    BMS.ProdDay = EEPROM.read(EE_CACHE(BattDate) + 5);
+    return true;
+  }
+  unsigned long tStart = millis();
+  boolean fOK = DiagCAN.getBatteryDate(&BMS, false);
+  if (fOK && myCache.active) {
+    EEPROM.update(EE_CACHE(BattDate), BMS.Year);
+    EEPROM.update(EE_CACHE(BattDate) + 1, BMS.Month);
+    EEPROM.update(EE_CACHE(BattDate) + 2, BMS.Day);
+    EEPROM.update(EE_CACHE(BattDate) + 3, BMS.ProdYear);
+    EEPROM.update(EE_CACHE(BattDate) + 4, BMS.ProdMonth);
+    EEPROM.update(EE_CACHE(BattDate) + 5, BMS.ProdDay);
+    cacheSetValid(ID_BATT_DATE, millis() - tStart);
+  }
+  return fOK;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get battery HW and SW revision, from cache if available
+//! \return  report success (boolean)
+//--------------------------------------------------------------------------------
+boolean getBatteryRevisionCached() {
+  byte n;
+  if (cacheValid(ID_BATT_REV)) {
+    for (n = 0; n < 3; n++) {
+      BMS.hw.rev[n] = EEPROM.read(EE_CACHE(BattRev) + n);
+      BMS.sw.rev[n] = EEPROM.read(EE_CACHE(BattRev) + 3 + n);
+    }
+    return true;
+  }
+  unsigned long tStart = millis();
+  boolean fOK = DiagCAN.getBatteryRevision(&BMS, false);
+  if (fOK && myCache.active) {
+    for (n = 0; n < 3; n++) {
+      EEPROM.update(EE_CACHE(BattRev) + n, BMS.hw.rev[n]);
+      EEPROM.update(EE_CACHE(BattRev) + 3 + n, BMS.sw.rev[n]);
+    }
+    cacheSetValid(ID_BATT_REV, millis() - tStart);
+  }
+  return fOK;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Check if a NLG6 charger is installed, from cache if available
+//! \return  NLG6 present (boolean)
+//--------------------------------------------------------------------------------
+boolean NLG6ChargerInstalledCached() {
+  byte n;
+  if (cacheValid(ID_NLG6_PN)) {
+    for (n = 0; n < 10; n++) {
+      NLG6.PN_HW[n] = EEPROM.read(EE_CACHE(PN_HW) + n);
+    }
+    return (EEPROM.read(EE_CACHE(NLG6present)) > 0);
+  }
+  unsigned long tStart = millis();
+  boolean fPresent = DiagCAN.NLG6ChargerInstalled(&NLG6, false);
+  //Part number empty if the charger did not answer
+  if (NLG6.PN_HW[0] != 0 && myCache.active) {
+    for (n = 0; n < 10; n++) {
+      EEPROM.update(EE_CACHE(PN_HW) + n, NLG6.PN_HW[n]);
+    }
+    EEPROM.update(EE_CACHE(NLG6present), fPresent);
+    cacheSetValid(ID_NLG6_PN, millis() - tStart);
+  }
+  return fPresent;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Print NLG6 SW revisions, from cache if available. A revision longer
+//! \brief   than the cache is printed cut and marked, but not cached.
+//! \return  report success (boolean)
+//--------------------------------------------------------------------------------
+boolean printNLG6ChargerSWrevCached() {
+  byte rev[SWREV_SIZE + 1];      //one byte more shows a revision too long to cache
+  byte length = EEPROM.read(EE_CACHE(SWrevLength));
+  if (length > 0 && length <= SWREV_SIZE && cacheValid(ID_NLG6_SW)) {
+    for (byte n = 0; n < length; n++) {
+      rev[n] = EEPROM.read(EE_CACHE(SWrev) + n);
+    }
+  } else {
+    unsigned long tStart = millis();
+    length = DiagCAN.getChargerSWrev(rev, sizeof(rev));
+    if (length == 0) return false;
+    if (length > SWREV_SIZE) {
+      DiagCAN.printChargerSWrev(rev, SWREV_SIZE);
+      Serial.println(F("... (truncated)"));
+      return true;
+    }
+    if (myCache.active) {
+      EEPROM.update(EE_CACHE(SWrevLength), length);
+      for (byte n = 0; n < length; n++) {
+        EEPROM.update(EE_CACHE(SWrev) + n, rev[n]);
+      }
+      cacheSetValid(ID_NLG6_SW, millis() - tStart);
+    }
+  }
+  DiagCAN.printChargerSWrev(rev, length);
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Output requests and time saved by the identity cache
+//--------------------------------------------------------------------------------
+void printCacheStatus() {
+  Serial.print(F("Identity cache: "));
+  if (!myCache.active) {
+    Serial.println(F("no VIN"));
+    return;
+  }
+  Serial.print(myCache.requests); Serial.print(F(" requests, "));
+  Serial.print(myCache.time); Serial.println(F(" ms skipped"));
+}
@@ -0,0 +1,213 @@
+//--------------------------------------------------------------------------------
+// (c) 2015-2018 by MyLab-odyssey
+// (c) 2017-2020 by Jim Sokoloff
+//
+// Licensed under "MIT License (MIT)", see license file for more information.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER OR CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//--------------------------------------------------------------------------------
+//! \file    ED_BMSdiag_MON.ino
+//! \brief   Bus monitor: message rate, inter-arrival times and payload changes
+//! \brief   of every CAN ID on the bus, estimated bus load
+//! \date    2020-April
+//! \author  MyLab-odyssey
+//! \version 1.0.8b
+//--------------------------------------------------------------------------------
+
+#define MON_BATCH 4              //!< frames read from the receive ring at once
+
+//--------------------------------------------------------------------------------
+//! \brief   Start the bus monitor, all IDs pass the filters. The table is kept
+//! \brief   in the response buffer of DiagCAN, requests fail while it runs.
+//! \param   lowest ID tracked (uint16_t), to scan the bus in several passes
+//! \return  monitor started (boolean)
+//--------------------------------------------------------------------------------
+boolean startMonitor(uint16_t from) {
+  if (!myMonitor.active) {
+    myMonitor.table = (monitorID_t*) DiagCAN.lendBuffer();
+    if (!myMonitor.table) return false;
+    DiagCAN.setBackground(NULL);
+    DiagCAN.clearCAN_Filter();
+  }
+  myMonitor.from = from;
+  clearMonitor();
+  myMonitor.active = true;
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Stop the bus monitor, the table is dropped and the diagnostic 
+//! \brief   filters are set again
+//--------------------------------------------------------------------------------
+void stopMonitor() {
+  myMonitor.active = false;
+  myMonitor.table = NULL;
+  DiagCAN.returnBuffer();
+  DiagCAN.setCAN_Filter_Diag();
+  if (myDevice.background) DiagCAN.setBackground(&BMS);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Drop the statistics collected so far
+//--------------------------------------------------------------------------------
+void clearMonitor() {
+  myMonitor.IDs = 0;
+  myMonitor.dropped = 0;
+  myMonitor.bits = 0;
+  myMonitor.start = millis();
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Bits of a frame on the bus, stuff bits are estimated as half of
+//! \brief   the worst case
+//! \param   extended ID (byte), data length (byte)
+//! \return  bits (uint16_t)
+//--------------------------------------------------------------------------------
+uint16_t frameBits(byte ext, byte len) {
+  uint16_t stuffed = (ext ? 54 : 34) + 8 * len;   //SOF to CRC, subject to stuffing
+  return stuffed + 13 + stuffed / 10;             //CRC delimiter, ACK, EOF, IFS
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Hash of a payload to see if the content of an ID changes
+//! \param   data (byte*), data length (byte)
+//! \return  hash (byte)
+//--------------------------------------------------------------------------------
+byte payloadHash(const byte *buf, byte len) {
+  byte hash = len;
+  for (byte n = 0; n < len; n++) {
+    hash = ((hash << 1) | (hash >> 7)) ^ buf[n];
+  }
+  return hash;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Find the table entry of an ID, a new one is inserted in order. If
+//! \brief   the table is full, the highest ID makes room for a lower one.
+//! \param   CAN ID (uint16_t)
+//! \return  entry (monitorID_t*), NULL if the ID is not tracked
+//--------------------------------------------------------------------------------
+monitorID_t *findMonitorID(uint16_t ID) {
+  if (ID < myMonitor.from) return NULL;
+  byte lo = 0, hi = myMonitor.IDs;
+  while (lo < hi) {
+    byte mid = (lo + hi) / 2;
+    if (myMonitor.table[mid].ID < ID) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < myMonitor.IDs && myMonitor.table[lo].ID == ID) return &myMonitor.table[lo];
+  if (myMonitor.IDs >= MON_IDS) {
+    if (lo == myMonitor.IDs) return NULL;
+    myMonitor.dropped += myMonitor.table[--myMonitor.IDs].count;
+  }
+  memmove(&myMonitor.table[lo + 1], &myMonitor.table[lo], (myMonitor.IDs - lo) * sizeof(monitorID_t));
+  myMonitor.IDs++;
+  memset(&myMonitor.table[lo], 0, sizeof(monitorID_t));
+  myMonitor.table[lo].ID = ID;
+  myMonitor.table[lo].minGap = 0xFFFF;
+  return &myMonitor.table[lo];
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Add a received frame to the statistics
+//! \param   frame (CAN_FRAME*) with the time it was read from the MCP2515
+//--------------------------------------------------------------------------------
+void monitorFrame(const CAN_FRAME *frame) {
+  myMonitor.bits += frameBits(frame->ext, frame->len);
+  monitorID_t *entry = findMonitorID(frame->id);
+  if (!entry) {
+    myMonitor.dropped++;
+    return;
+  }
+  if (entry->count > 0) {
+    uint16_t gap = (uint16_t) frame->time - entry->last;     //periods up to 65 s
+    if (gap < entry->minGap) entry->minGap = gap;
+    if (gap > entry->maxGap) entry->maxGap = gap;
+    entry->meanGap += ((long) gap - entry->meanGap) / (long) entry->count;
+  }
+  entry->last = frame->time;
+  if (entry->count < 0xFFFF) entry->count++;
+  entry->len = frame->len;
+  entry->hash = payloadHash(frame->buf, frame->len);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Read waiting frames into the monitor, called from the main loop.
+//! \brief   At most one ring of frames per call, the CLI stays responsive.
+//--------------------------------------------------------------------------------
+void pollMonitor() {
+  CAN_FRAME frames[MON_BATCH];
+  byte n, total = 0;
+  do {
+    n = CAN0.readMsgBufs(frames, MON_BATCH);
+    for (byte i = 0; i < n; i++) {
+      monitorFrame(&frames[i]);
+    }
+    total += n;
+  } while (n == MON_BATCH && total < CAN_RX_RING);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Output the statistics sorted by ID: count, inter-arrival times in
+//! \brief   ms (min/mean/max), last DLC and payload hash, estimated bus load
+//--------------------------------------------------------------------------------
+void printMonitor() {
+  unsigned long elapsed = millis() - myMonitor.start;
+  Serial.print(F("Monitor ")); Serial.print(myMonitor.active ? F("running") : F("stopped"));
+  Serial.print(F(", ")); Serial.print(elapsed / 1000); Serial.print(F(" s, IDs from "));
+  Serial.println(myMonitor.from, HEX);
+  if (!myMonitor.table) return;
+  Serial.println(F("ID    count  min mean  max DLC hash"));
+  for (byte n = 0; n < myMonitor.IDs; n++) {
+    monitorID_t *entry = &myMonitor.table[n];
+    if (entry->ID < 0x100) Serial.print(F("0"));
+    if (entry->ID < 0x10) Serial.print(F("0"));
+    Serial.print(entry->ID, HEX); Serial.print(F(" "));
+    printPadded(entry->count, 7);
+    if (entry->count > 1) {
+      printPadded(entry->minGap, 5);
+      printPadded(entry->meanGap, 5);
+      printPadded(entry->maxGap, 5);
+    } else {
+      Serial.print(F("    -    -    -"));
+    }
+    printPadded(entry->len, 4);
+    Serial.print(F("   "));
+    if (entry->hash < 0x10) Serial.print(F("0"));
+    Serial.println(entry->hash, HEX);
+  }
+  if (myMonitor.dropped) {
+    Serial.print(F("Frames of untracked IDs: ")); Serial.print(myMonitor.dropped);
+    Serial.println(F(", scan further IDs with mon on [ID]"));
+  }
+  Serial.print(F("Bus load: "));
+  if (elapsed > 0) {
+    Serial.print((float) myMonitor.bits * 100.0 / ((float) MON_BITRATE * elapsed / 1000.0), 1);
+    Serial.println(F(" %"));
+  } else {
+    Serial.println(F("-"));
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Output a number right aligned
+//! \param   value (unsigned long), width (byte)
+//--------------------------------------------------------------------------------
+void printPadded(unsigned long value, byte width) {
+  byte digits = 1;
+  for (unsigned long v = value; v >= 10; v /= 10) digits++;
+  while (digits++ < width) Serial.print(F(" "));
+  Serial.print(value);
+}
@@ -58,7 +58,7 @@ void printWelcomeScreen() {
     }
     Serial.print(F("."));
     delay(1000);
-  } while (digitalRead(2));
+  } while (CAN0.checkReceive() != CAN_MSGAVAIL);
   Serial.println(F("CONNECTED"));
   PrintSPACER();
 }
@@ -133,6 +133,14 @@ void printExperimentalData() {
 //! \brief   Output standard dataset
 //--------------------------------------------------------------------------------
 void printStandardDataset() {
+  if (myDevice.background) {
+    for (byte field = 0; field < SNIFF_FIELDS; field++) {
+      if (DiagCAN.isStale(field)) {
+        Serial.println(F("NOTICE - broadcast values not current, see bg"));
+        break;
+      }
+    }
+  }
   Serial.print(F("SOC : ")); Serial.print(BMS.SOC,1); Serial.print(F(" %"));
   Serial.print(F(", realSOC: ")); Serial.print((float) BMS.realSOC / 10.0, 1); Serial.println(F(" %"));
   Serial.print(F("HV  : ")); Serial.print(BMS.HV,1); Serial.print(F(" V, "));
@@ -388,7 +396,7 @@ void printNLG6revision() {
   if (NLG6.NLG6present) {
     Serial.print(F("HW PN : ")); Serial.println(NLG6.PN_HW);
     Serial.print(F("SW rev: "));
-    DiagCAN.printNLG6ChargerSWrev(&NLG6, false); //get SW revisons and send to serial
+    printNLG6ChargerSWrevCached();             //get SW revisons and send to serial
   }
 }
 
@@ -441,29 +449,49 @@ void printBMSdata() {
   PrintSPACER();
   printHeaderData();
   PrintSPACER();
-  printBatteryProductionData(false);
-  PrintSPACER();
-  printStandardDataset();
-  PrintSPACER();
-  printBMS_CellVoltages();
-  PrintSPACER();
-  printBMS_CapacityEstimate();
-  PrintSPACER();
-  printHVcontactorState();
-  PrintSPACER();
-  printBMStemperatures();
-  PrintSPACER();
-  if (VERBOSE) {
+  printBMSsections(~myReadout.BMSfailed, true);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Output the parts of the BMS dataset read by the given steps
+//! \param   steps of getBMSdata (bit per step), include sniffed data (boolean)
+//--------------------------------------------------------------------------------
+void printBMSsections(uint16_t steps, boolean fSniffed) {
+  if (steps & (bit(6) | bit(7))) {
+    printBatteryProductionData(false);
+    PrintSPACER();
+  }
+  if (fSniffed || (steps & (bit(2) | bit(10)))) {
+    printStandardDataset();
+    PrintSPACER();
+  }
+  if (steps & bit(5)) {
+    printBMS_CellVoltages();
+    PrintSPACER();
+  }
+  if (steps & bit(1)) {
+    printBMS_CapacityEstimate();
+    PrintSPACER();
+  }
+  if (steps & (bit(9) | bit(11))) {
+    printHVcontactorState();
+    PrintSPACER();
+  }
+  if (steps & bit(8)) {
+    printBMStemperatures();
+    PrintSPACER();
+  }
+  if (VERBOSE && (steps & bit(0)) && (steps & bit(1))) {
     printIndividualCellData();
     PrintSPACER();
   }
-  if (BOXPLOT) {
+  if (BOXPLOT && (steps & bit(0))) {
     DiagCAN.getBatteryVoltageDist(&BMS);  //Sort cell voltages rising up and calc. quartiles
                                           //!!! after sorting track of individual cells is lost -> redo ".getBatteryVoltages" !!!
     printVoltageDistribution();           //Print statistic data as boxplot
     PrintSPACER();
   }
-  if (myDevice.experimental) {
+  if (myDevice.experimental && (steps & bit(3))) {
     printExperimentalData();
     PrintSPACER();
   }
@@ -476,10 +504,14 @@ void printNLG6data() {
   Serial.println(MSG_OK);
   digitalWrite(CS, HIGH);
   PrintSPACER();
-  printNLG6_Status();
-  PrintSPACER();
-  printNLG6temperatures();
-  PrintSPACER();
+  if ((myReadout.NLG6failed & 0x07) != 0x07) {
+    printNLG6_Status();
+    PrintSPACER();
+  }
+  if (!bitRead(myReadout.NLG6failed, 3)) {
+    printNLG6temperatures();
+    PrintSPACER();
+  }
   if (NLG6.NLG6present) {
     printNLG6revision();
     PrintSPACER();
@@ -575,6 +607,81 @@ void printRPTdata() {
   PrintSPACER();
 }
 
+//--------------------------------------------------------------------------------
+//! \brief   Output steps not obtained by the last readout
+//--------------------------------------------------------------------------------
+void printFailedSteps() {
+  Serial.print(F("Not obtained:"));
+  for (byte i = 0; i < BMS_STEPS; i++) {
+    if (bitRead(myReadout.BMSfailed, i)) {
+      Serial.print(F(" BMS#")); Serial.print(i);
+    }
+  }
+  for (byte i = 0; i < NLG6_STEPS; i++) {
+    if (bitRead(myReadout.NLG6failed, i)) {
+      Serial.print(F(" NLG6#")); Serial.print(i);
+    }
+  }
+  Serial.println();
+  Serial.println(F("Type 'retry' to read them again"));
+  PrintSPACER();
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Output latency of the steps of the last readout, F := failed
+//--------------------------------------------------------------------------------
+void printReadoutStatus() {
+  Serial.print(F("BMS steps [ms] :"));
+  for (byte i = 0; i < BMS_STEPS; i++) {
+    Serial.print(F(" ")); Serial.print(myReadout.BMStime[i]);
+    if (bitRead(myReadout.BMSfailed, i)) Serial.print(MSG_FAIL);
+  }
+  Serial.println();
+  Serial.print(F("NLG6 steps [ms]:"));
+  for (byte i = 0; i < NLG6_STEPS; i++) {
+    Serial.print(F(" ")); Serial.print(myReadout.NLG6time[i]);
+    if (bitRead(myReadout.NLG6failed, i)) Serial.print(MSG_FAIL);
+  }
+  Serial.println();
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Output age of the values of each step in s with their source:
+//! \brief   S := sniffed, U := UDS request, C := identity cache, - := not read
+//--------------------------------------------------------------------------------
+void printFreshness() {
+  Serial.print(F("Max. age: "));
+  if (myDevice.maxAge == AGE_SESSION) {
+    Serial.println(F("default"));
+  } else {
+    Serial.print(myDevice.maxAge); Serial.println(F(" s"));
+  }
+  uint16_t now = millis() / 1000;
+  for (byte group = 0; group < FRESH_COUNT; group++) {
+    if (group == FRESH_SNIFF) Serial.print(F("Age sniffed [s]:"));
+    if (group == FRESH_BMS) Serial.print(F("Age BMS [s]    :"));
+    if (group == FRESH_NLG6) Serial.print(F("Age NLG6 [s]   :"));
+    if (group == FRESH_CLS) Serial.print(F("Age CS [s]     :"));
+    Serial.print(F(" "));
+    switch (myFresh[group].source) {
+      case SRC_SNIFF:
+        Serial.print((uint16_t) (now - myFresh[group].time)); Serial.print(F("S"));
+        break;
+      case SRC_UDS:
+        Serial.print((uint16_t) (now - myFresh[group].time)); Serial.print(F("U"));
+        break;
+      case SRC_CACHE:
+        Serial.print((uint16_t) (now - myFresh[group].time)); Serial.print(F("C"));
+        break;
+      default:
+        Serial.print(F("-"));
+    }
+    if (group + 1 == FRESH_BMS || group + 1 == FRESH_NLG6 || group + 1 == FRESH_CLS || group + 1 == FRESH_COUNT) {
+      Serial.println();
+    }
+  }
+}
+
 //--------------------------------------------------------------------------------
 //! \brief   Get all BMS data and output them
 //! \brief   Dynamic memory allocation for CellVoltages and -Capacities
@@ -600,6 +707,9 @@ void printBMSall() {
   }
   if (getBMSdata(selected, 12)) {
     printBMSdata();
+  } else if (myDevice.partial && myReadout.BMSfailed != BMS_ALL) {
+    printBMSdata();
+    printFailedSteps();
   } else {
     g_failure++;
     Serial.println();
@@ -616,8 +726,11 @@ void printBMSall() {
 //--------------------------------------------------------------------------------
 void printNLG6all() {
   Serial.print(F("Reading data"));
-  if (getNLG6data()) {
+  if (getNLG6data(NLG6_ALL)) {
+    printNLG6data();
+  } else if (myDevice.partial && myReadout.NLG6failed != NLG6_ALL) {
     printNLG6data();
+    printFailedSteps();
   } else {
     g_failure++;
     Serial.println();
@@ -24,7 +24,7 @@
 #define BMS_DFS_H
 
 //Definitions for BMS
-#define DATALENGTH 238
+#define DATALENGTH 128
 #define CELLCOUNT 93
 #define RAW_VOLTAGES 0           //!< Use RAW values or calc ADC offset voltage
 #define IQR_FACTOR 1.5           //!< Factor to define Outliners-Range, 1.5 for suspected outliners, 3 for definitive outliners
@@ -127,12 +127,17 @@ const PROGMEM byte rqBattTemperatures[4]          = {0x03, 0x22, 0x02, 0x01};  /
 const PROGMEM byte rqBattModuleTemperatures[4]    = {0x03, 0x22, 0x02, 0x02};  // 63 bytes
 const PROGMEM byte rqBattHVstatus[4]              = {0x03, 0x22, 0x02, 0x04};  // 5-6 bytes
 const PROGMEM byte rqBattADCref[4]                = {0x03, 0x22, 0x02, 0x07};  // 6 bytes max, min, mean [4,6,8]
-const PROGMEM byte rqBattVolts[6]                 = {0x03, 0x22, 0x02, 0x08, 28, 57}; // 93*2 raw voltage (starting at 4) typical range is +/- 8 (0xfc1-0xfc9)
+const PROGMEM byte rqBattVolts[4]                 = {0x03, 0x22, 0x02, 0x08}; // 93*2 raw voltage (starting at 4) typical range is +/- 8 (0xfc1-0xfc9)
 const PROGMEM byte rqBattIsolation[4]             = {0x03, 0x22, 0x02, 0x09};  // 3 bytes, 2 for isolation [45], 1 for flags [6]
 const PROGMEM byte rqBattAmps[4]                  = {0x03, 0x22, 0x02, 0x03};  //
 const PROGMEM byte rqBattDate[4]                  = {0x03, 0x22, 0x03, 0x04};  // 3 bytes [46] -> Factory Acceptance Date
 const PROGMEM byte rqBattProdDate[4]              = {0x03, 0x22, 0xF1, 0x8C};  // 6 bytes data [49] -> ASCII format? 14 bytes raw data
-const PROGMEM byte rqBattCapacity[6]              = {0x03, 0x22, 0x03, 0x10, 31, 59}; // 430 bytes raw; 207 used; 93*2 raw capacity (start at 25) + 3 HVOffTime [57] + 3 lowCurrent [9-11] + 2 OCVtimer [12-13] + 1 SOH [14] + 6 min, max, mean (21, 17, 23) + 2 lastMeasurementDays [224] + 2 measurementQual [226] + 2 overallQuality [222]
+const PROGMEM byte rqBattCapacity[4]              = {0x03, 0x22, 0x03, 0x10}; // 430 bytes raw; 31 kept; 93*2 raw capacity (start at 25) + 3 HVOffTime [5-7] + 3 lowCurrent [9-11] + 2 OCVtimer [12-13] + 1 SOH [14] + 6 min, max, mean (21, 17, 23) + 2 overallQuality [25] + 2 lastMeasurementDays [27] + 2 measurementQual [29]
+
+//! Parts of the voltage and capacity responses kept in the data buffer, 
+//! cell values are decoded while received (raw voltages at 4, capacities at 25)
+const PROGMEM DataWindow_t wnBattVolts[]    = {{0, 4, 0}};
+const PROGMEM DataWindow_t wnBattCapacity[] = {{0, 25, 0}, {425, 6, 25}};  // header, SOH, Cap_As [5..24]; qualities, last measurement [425..430]
 // 0x45c0 - 0x4762 range on cabrio
 // 
 // 0x4512 - 0x45fb on peadpod as range, was a 0x44c6, 0x45fb,  
@@ -149,4 +154,11 @@ const PROGMEM byte rqBattCapInit[4]               = {0x03, 0x22, 0x03, 0x05};  /
 const PROGMEM byte rqBattCapLoss[4]               = {0x03, 0x22, 0x03, 0x09};  //
 const PROGMEM byte rqBattUnknownCounter[4]        = {0x03, 0x22, 0x01, 0x01};  //
 
+//! Values read by getHVcontactorState (cycle counters seemed absent on cabrio and peapod)
+const PROGMEM DiagDID_t didHVcontactor[] = {
+  {rqBattHVContactorCyclesLeft, 4, DID_U24, 1, DID_ALL, offsetof(BatteryDiag_t, HVcontactCyclesLeft), 0},
+  {rqBattHVContactorMax,        4, DID_U24, 1, DID_ALL, offsetof(BatteryDiag_t, HVcontactCyclesMax),  0},
+  {rqBattHVContactorState,      3, DID_U8,  1, DID_ALL, offsetof(BatteryDiag_t, HVcontactState),      0}
+};
+
 #endif // of #ifndef BMS_DFS_H
@@ -56,4 +56,21 @@ const PROGMEM byte rqVacuumPumpOTR[4]             = {0x03, 0x22, 0x63, 0x03};
 const PROGMEM byte rqVacuumPumpPress1[4]          = {0x03, 0x22, 0x20, 0x41};
 const PROGMEM byte rqVacuumPumpPress2[4]          = {0x03, 0x22, 0x20, 0x43};
 
+//! Values read by getCoolingAndSubsystems
+const PROGMEM DiagDID_t didCLS[] = {
+  {rqCoolingTemp,      3, DID_U16,   1, DID_ALL, offsetof(CoolingSub_t, CoolingTemp),      0},
+  {rqCoolingPumpTemp,  3, DID_U8,    1, DID_ALL, offsetof(CoolingSub_t, CoolingPumpTemp),  0},
+  {rqCoolingPumpLV,    3, DID_U8,    1, DID_ALL, offsetof(CoolingSub_t, CoolingPumpLV),    0},
+  {rqCoolingPumpAmps,  4, DID_U8W,   1, DID_ALL, offsetof(CoolingSub_t, CoolingPumpAmps),  0},
+  {rqCoolingPumpRPM,   3, DID_U8,    1, DID_ALL, offsetof(CoolingSub_t, CoolingPumpRPM),   0},
+  {rqCoolingPumpOTR,   3, DID_U16,   1, DID_ALL, offsetof(CoolingSub_t, CoolingPumpOTR),   0},
+  {rqCoolingFanRPM,    3, DID_U8,    1, DID_ALL, offsetof(CoolingSub_t, CoolingFanRPM),    0},
+  {rqCoolingFanOTR,    3, DID_U16,   1, DID_ALL, offsetof(CoolingSub_t, CoolingFanOTR),    0},
+  {rqBatteryHeaterOTR, 3, DID_U16,   1, DID_ALL, offsetof(CoolingSub_t, BatteryHeaterOTR), 0},
+  {rqBatteryHeaterON,  3, DID_U8,    1, DID_ALL, offsetof(CoolingSub_t, BatteryHeaterON),  0},
+  {rqVacuumPumpOTR,    3, DID_OTR24, 1, DID_ALL, offsetof(CoolingSub_t, VaccumPumpOTR),    0},
+  {rqVacuumPumpPress1, 3, DID_U16,   1, DID_ALL, offsetof(CoolingSub_t, VaccumPumpPress1), 0},
+  {rqVacuumPumpPress2, 3, DID_U16,   1, DID_ALL, offsetof(CoolingSub_t, VaccumPumpPress2), 0}
+};
+
 #endif // of #ifndef CS_DFS_H
@@ -0,0 +1,61 @@
+//--------------------------------------------------------------------------------
+// (c) 2015-2017 by MyLab-odyssey
+//
+// Licensed under "MIT License (MIT)", see license file for more information.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDER OR CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR
+// ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+// ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//--------------------------------------------------------------------------------
+//! \file    DID_dfs.h
+//! \brief   Descriptors for values read by diagnostic requests (DIDs).
+//! \date    2020-March
+//! \author  Jim Sokoloff
+//! \version 0.1.0
+//--------------------------------------------------------------------------------
+#ifndef DID_DFS_H
+#define DID_DFS_H
+
+#include <stddef.h>
+
+//! Coding of a value in the response data
+typedef enum {
+  DID_U8 = 0,                    //!< one byte to byte
+  DID_U8W,                       //!< one byte to word
+  DID_U16,                       //!< two bytes (high, low) to word
+  DID_U24,                       //!< three bytes to long
+  DID_OTR24,                     //!< three bytes to long, (value << 8) / 10 (operating time record)
+  DID_ZERO16                     //!< no data, word set to 0
+} DIDtype_t;
+
+//! Charger variant a value is valid for
+typedef enum {DID_ALL = 0, DID_NLG6, DID_OBL} DIDvariant_t;
+
+//! Descriptor of a value read by a diagnostic request, see canDiag::ReadDIDs.
+//! Entries of one request have to follow each other in the table.
+typedef struct {
+  const byte *rq;                //!< diagnostic request (PROGMEM)
+  byte pos;                      //!< position of first (high) byte in response data
+  byte type;                     //!< coding of the value (DIDtype_t)
+  byte count;                    //!< count of consecutive values (arrays)
+  byte variant;                  //!< charger variant (DIDvariant_t)
+  byte field;                    //!< offset of destination in data structure
+  uint16_t invalid;              //!< raw word value to be reported as 0, 0 := none
+} DiagDID_t;
+
+//! Window of a response kept in the data buffer, positions of the response 
+//! count from the length byte of the first frame (data[0] without windows)
+typedef struct {
+  uint16_t start;                //!< first byte in response
+  byte length;                   //!< count of bytes
+  byte dest;                     //!< position in data buffer
+} DataWindow_t;
+
+#endif // of #ifndef DID_DFS_H
@@ -51,6 +51,46 @@ const PROGMEM byte rqChargerAmps[4]               = {0x03, 0x22, 0x02, 0x25};
 const PROGMEM byte rqChargerSelCurrent[4]         = {0x03, 0x22, 0x02, 0x2A};
 const PROGMEM byte rqChargerTemperatures[4]       = {0x03, 0x22, 0x02, 0x23}; 
 
+//! Values read by getChargerVoltages, OBL reports 8190 while not charging
+const PROGMEM DiagDID_t didChargerVoltages[] = {
+  {rqChargerVoltages,  8, DID_U8,     1, DID_NLG6, offsetof(ChargerDiag_t, LV),              0},
+  {rqChargerVoltages,  9, DID_U16,    1, DID_NLG6, offsetof(ChargerDiag_t, DC_HV),           0},
+  {rqChargerVoltages, 11, DID_U16,    3, DID_NLG6, offsetof(ChargerDiag_t, MainsVoltage),    0},
+  {rqChargerVoltages,  6, DID_U8,     1, DID_OBL,  offsetof(ChargerDiag_t, LV),              0},
+  {rqChargerVoltages,  9, DID_U16,    1, DID_OBL,  offsetof(ChargerDiag_t, DC_HV),           8190},
+  {rqChargerVoltages, 11, DID_U16,    1, DID_OBL,  offsetof(ChargerDiag_t, MainsVoltage),    8190},
+  {rqChargerVoltages,  0, DID_ZERO16, 2, DID_OBL,  offsetof(ChargerDiag_t, MainsVoltage[1]), 0}
+};
+
+//! Values read by getChargerAmps, OBL reports 2047 while not charging
+const PROGMEM DiagDID_t didChargerAmps[] = {
+  {rqChargerAmps,  4, DID_U16,    1, DID_NLG6, offsetof(ChargerDiag_t, DC_Current),        0},
+  {rqChargerAmps,  6, DID_U16,    3, DID_NLG6, offsetof(ChargerDiag_t, MainsAmps),         0},
+  {rqChargerAmps, 16, DID_U16,    1, DID_NLG6, offsetof(ChargerDiag_t, AmpsChargingpoint), 0},
+  {rqChargerAmps, 18, DID_U16,    1, DID_NLG6, offsetof(ChargerDiag_t, AmpsCableCode),     0},
+  {rqChargerAmps,  6, DID_U16,    1, DID_OBL,  offsetof(ChargerDiag_t, MainsAmps),         2047},
+  {rqChargerAmps,  0, DID_ZERO16, 2, DID_OBL,  offsetof(ChargerDiag_t, MainsAmps[1]),      0},
+  {rqChargerAmps, 18, DID_U16,    1, DID_OBL,  offsetof(ChargerDiag_t, DC_Current),        2047},
+  {rqChargerAmps, 14, DID_U16,    1, DID_OBL,  offsetof(ChargerDiag_t, AmpsCableCode),     0}
+};
+
+//! Values read by getChargerSelCurrent
+const PROGMEM DiagDID_t didChargerSelCurrent[] = {
+  {rqChargerSelCurrent, 8, DID_U8, 1, DID_NLG6, offsetof(ChargerDiag_t, Amps_setpoint), 0},
+  {rqChargerSelCurrent, 7, DID_U8, 1, DID_OBL,  offsetof(ChargerDiag_t, Amps_setpoint), 0}
+};
+
+//! Values read by getChargerTemperature
+const PROGMEM DiagDID_t didChargerTemperatures[] = {
+  {rqChargerTemperatures,  4, DID_U8, 1, DID_NLG6, offsetof(ChargerDiag_t, CoolingPlateTemp), 0},
+  {rqChargerTemperatures,  5, DID_U8, 8, DID_NLG6, offsetof(ChargerDiag_t, Temps),            0},
+  {rqChargerTemperatures, 12, DID_U8, 1, DID_NLG6, offsetof(ChargerDiag_t, ReportedTemp),     0},
+  {rqChargerTemperatures, 13, DID_U8, 1, DID_NLG6, offsetof(ChargerDiag_t, SocketTemp),       0},
+  {rqChargerTemperatures,  5, DID_U8, 1, DID_OBL,  offsetof(ChargerDiag_t, CoolingPlateTemp), 0},
+  {rqChargerTemperatures,  7, DID_U8, 1, DID_OBL,  offsetof(ChargerDiag_t, ReportedTemp),     0},
+  {rqChargerTemperatures,  9, DID_U8, 1, DID_OBL,  offsetof(ChargerDiag_t, SocketTemp),       0}
+};
+
 const char NLG6_PN_HW[] = "4519822221";  //!< Part number for NLG6 fast charging hardware
 
 #endif // of #ifndef NLG6_DFS_H
@@ -34,13 +34,130 @@ uint32_t combine_bytes_3(uint8_t bh, uint8_t bm, uint8_t bl) {
 
 uint16_t g_failure = 0;
 
+//! Request and response CAN IDs of the ECUs (ECU_t)
+const uint16_t kECU_ID[ECU_COUNT][2] PROGMEM = {{0x7E7, 0x7EF}, {0x61A, 0x483}, {0x7E5, 0x7ED}};
+
+//--------------------------------------------------------------------------------
+//! \brief   Decoders of broadcast messages
+//--------------------------------------------------------------------------------
+static void decodeSOC(void *dest, const byte *buf) {
+  ((BatteryDiag_t*) dest)->SOC = (float) buf[7] / 2;
+}
+static void decodeRealSOC(void *dest, const byte *buf) {
+  ((BatteryDiag_t*) dest)->realSOC = combine_bytes(buf[4], buf[5]) & 0x3ff;
+}
+static void decodeAmps(void *dest, const byte *buf) {
+  int16_t value = combine_bytes(buf[2], buf[3]) & 0x3fff;
+  ((BatteryDiag_t*) dest)->Amps2 = (value - 0x2000) / 10.0;
+}
+static void decodeHV(void *dest, const byte *buf) {
+  ((BatteryDiag_t*) dest)->HV = (float)combine_bytes(buf[6], buf[7]) / 10.0;
+}
+static void decodeLV(void *dest, const byte *buf) {
+  ((BatteryDiag_t*) dest)->LV = (float)buf[3] / 10.0;
+}
+static void decodeODO(void *dest, const byte *buf) {
+  ((BatteryDiag_t*) dest)->ODO = combine_bytes_3(buf[2], buf[3], buf[4]);
+}
+static void decodeTime(void *dest, const byte *buf) {
+  ((BatteryDiag_t*) dest)->hour = buf[0];
+  ((BatteryDiag_t*) dest)->minutes = buf[1];
+}
+static void decodeVelocity(void *dest, const byte *buf) {
+  ((DriveStats_t*) dest)->velocity = (((uint16_t)buf[2] << 8) | buf[3]) / 18;
+}
+static void decodeRange(void *dest, const byte *buf) {
+  ((DriveStats_t*) dest)->usablePower = buf[5];
+  ((DriveStats_t*) dest)->range = buf[7];
+}
+static void decodeEnergy(void *dest, const byte *buf) {
+  ((DriveStats_t*) dest)->energyStart = combine_bytes(buf[0], buf[1]);
+  ((DriveStats_t*) dest)->energyReset = combine_bytes(buf[2], buf[3]);
+}
+static void decodeHVactive(void *dest, const byte *buf) {
+  ((DriveStats_t*) dest)->HVactive = buf[0];
+}
+static void decodeECO(void *dest, const byte *buf) {
+  ((DriveStats_t*) dest)->ECO_accel = buf[0] >> 1;
+  ((DriveStats_t*) dest)->ECO_const = buf[1] >> 1;
+  ((DriveStats_t*) dest)->ECO_coast = buf[2] >> 1;
+  ((DriveStats_t*) dest)->ECO_total = buf[3] >> 1;
+}
+static void decodeUserCounter(void *dest, const byte *buf) {
+  uint16_t value;
+  value = combine_bytes(buf[1], buf[2]);
+  if (value != 254) ((DriveStats_t*) dest)->odoStart = value; 
+  value = combine_bytes(buf[4], buf[5]);
+  if (value != 254) ((DriveStats_t*) dest)->odoReset = value;
+}
+
+//! Broadcast messages of the battery system, sorted by CAN ID
+const CANdispatch_t kBMS_DISPATCH[] PROGMEM = {
+  {0x2D5, SNIFF_RSOC, decodeRealSOC},
+  {0x3D5, SNIFF_LV,   decodeLV},
+  {0x412, SNIFF_ODO,  decodeODO},
+  {0x448, SNIFF_HV,   decodeHV},
+  {0x508, SNIFF_AMPS, decodeAmps},
+  {0x512, SNIFF_TIME, decodeTime},
+  {0x518, SNIFF_SOC,  decodeSOC}
+};
+
+//! Broadcast messages of the drivetrain, sorted by CAN ID
+const CANdispatch_t kDRV_DISPATCH[] PROGMEM = {
+  {0x200, DRV_VELOCITY,  decodeVelocity},
+  {0x318, DRV_RANGE,     decodeRange},
+  {0x3CE, DRV_ENERGY,    decodeEnergy},
+  {0x3D7, DRV_HV_ACTIVE, decodeHVactive},
+  {0x3F2, DRV_ECO,       decodeECO},
+  {0x504, DRV_ODO,       decodeUserCounter}
+};
+
+#define ENTRIES(table) (sizeof(table) / sizeof(table[0]))
+
+//--------------------------------------------------------------------------------
+//! \brief   Find a CAN ID in a dispatch table by binary search
+//! \param   dispatch table in PROGMEM (CANdispatch_t*), count of entries, CAN ID, 
+//! \param   entry copied from PROGMEM (CANdispatch_t*)
+//! \return  ID found (boolean)
+//--------------------------------------------------------------------------------
+static boolean findDispatch(const CANdispatch_t *table, byte entries, uint16_t ID, CANdispatch_t *entry) {
+  byte lo = 0, hi = entries;
+  while (lo < hi) {
+    byte mid = (lo + hi) / 2;
+    uint16_t midID = pgm_read_word(&table[mid].ID);
+    if (midID < ID) {
+      lo = mid + 1;
+    } else if (midID > ID) {
+      hi = mid;
+    } else {
+      memcpy_P(entry, &table[mid], sizeof(CANdispatch_t));
+      return true;
+    }
+  }
+  return false;
+}
+
+//! Requests queued for the charger and cooling ECU, same order as read by the sketch
+const byte* const qNLG6[] PROGMEM = {rqChargerVoltages, rqChargerAmps, rqChargerSelCurrent, rqChargerTemperatures};
+const byte* const qCLS[] PROGMEM = {rqCoolingTemp, rqCoolingPumpTemp, rqCoolingPumpLV, rqCoolingPumpAmps, 
+                                    rqCoolingPumpRPM, rqCoolingPumpOTR, rqCoolingFanRPM, rqCoolingFanOTR, 
+                                    rqBatteryHeaterOTR, rqBatteryHeaterON, rqVacuumPumpOTR, 
+                                    rqVacuumPumpPress1, rqVacuumPumpPress2};
+
 //--------------------------------------------------------------------------------
 //! \brief   Standard constructor / destructor
 //--------------------------------------------------------------------------------
 canDiag::canDiag() {
+  for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+    FCprofile[ecu].BS = FC_BS_DEFAULT;
+    FCprofile[ecu].STmin = FC_STMIN_DEFAULT;
+    memset(&session[ecu], 0, sizeof(IsoTpSession_t));
+  }
+  memset(latest, 0, sizeof(latest));
 }
 
 canDiag::~canDiag() {  
+  this->clearQueue();
   delete[] data;
 }
 
@@ -107,57 +224,195 @@ void canDiag::begin(MCP_CAN *_myCAN, CTimeout *_myCAN_Timeout) {
 //! \brief   Clear CAN ID filters.
 //--------------------------------------------------------------------------------
 void canDiag::clearCAN_Filter(){
-  myCAN0->init_Mask(0, 0, 0x00000000);
-  myCAN0->init_Mask(1, 0, 0x00000000);
+  const unsigned long masks[2] = {0x00000000, 0x00000000};
+  const unsigned long filters[6] = {0, 0, 0, 0, 0, 0};
+  myCAN0->setFilterSet(masks, filters);
   //delay(100);
   myCAN0->setMode(MCP_NORMAL);                     // Set operation mode to normal so the MCP2515 sends acks to received data.
+  bgFiltered = true;                               // all IDs pass
 }
 
 //--------------------------------------------------------------------------------
 //! \brief   Set all filters to one CAN ID.
 //--------------------------------------------------------------------------------
 void canDiag::setCAN_Filter(unsigned long filter){
+  uint16_t list[FILTER_MAX_IDS];
+  if (fLent) return;                               // bus monitor owns the filters
+  list[0] = filter;
+  byte count = this->addBackgroundIDs(list, 1);
+  this->setCAN_Filters(list, count);               // normal mode is restored by setFilterSet
   this->respID = filter;
-  filter = filter << 16;
-  myCAN0->init_Mask(0, 0, 0x07FF0000);
-  myCAN0->init_Mask(1, 0, 0x07FF0000);
-  myCAN0->init_Filt(0, 0, filter);
-  myCAN0->init_Filt(1, 0, filter);
-  myCAN0->init_Filt(2, 0, filter);
-  myCAN0->init_Filt(3, 0, filter);
-  myCAN0->init_Filt(4, 0, filter);
-  myCAN0->init_Filt(5, 0, filter);
-  //delay(100);
-  myCAN0->setMode(MCP_NORMAL);                     // Set operation mode to normal so the MCP2515 sends acks to received data.
+  bgFiltered = (bgBMS != NULL);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Add the IDs of the background sniffer to a filter list, if it runs
+//! \param   CAN IDs (uint16_t*) with room for FILTER_MAX_IDS, count of IDs (byte)
+//! \return  new count of IDs (byte)
+//--------------------------------------------------------------------------------
+byte canDiag::addBackgroundIDs(uint16_t *list, byte count) {
+  if (bgBMS) {
+    for (byte i = 0; i < ENTRIES(kBMS_DISPATCH) && count < FILTER_MAX_IDS; i++) {
+      list[count++] = pgm_read_word(&kBMS_DISPATCH[i].ID);
+    }
+  }
+  return count;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Count the bits set, used to rate masks
+//--------------------------------------------------------------------------------
+static byte countBits(uint16_t value) {
+  byte n = 0;
+  for (; value; value &= value - 1) n++;
+  return n;
 }
 
+//--------------------------------------------------------------------------------
+//! \brief   Program the masks and filters to receive a set of 11 bit CAN IDs.
+//! \brief   Up to 6 IDs get a filter each (RXB0: 2, RXB1: 4, mask 0x7FF). More IDs
+//! \brief   are joined into 6 groups, always the two groups that add the fewest
+//! \brief   don't care bits to the mask. The groups are then split between RXB0 
+//! \brief   and RXB1 so that the fewest IDs pass the filters. If the set does not 
+//! \brief   fit exactly, unwanted IDs pass and must be dropped by the receiver.
+//! \param   CAN IDs (uint16_t*), count of IDs (byte), no more than FILTER_MAX_IDS
+//! \return  only the given IDs pass the filters (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::setCAN_Filters(const uint16_t *IDs, byte count) {
+  uint16_t base[FILTER_MAX_IDS];              // one ID of each group
+  uint16_t loose[FILTER_MAX_IDS];             // bits that differ within each group
+  uint16_t all = 0, mask0 = 0, mask1 = 0;
+  byte n, i, j, best_i = 0, best_j = 0;
+
+  if (fLent) return false;                    // bus monitor owns the filters
+  this->respID = 0;                           // filters no longer match a single response
+  bgFiltered = false;
+
+  if (count == 0) {
+    this->clearCAN_Filter();
+    return false;
+  }
+  n = (count < FILTER_MAX_IDS) ? count : FILTER_MAX_IDS;
+  for (i = 0; i < n; i++) {
+    base[i] = IDs[i] & 0x7FF;
+    loose[i] = 0;
+  }
 
+  //Join groups until one filter is left for each
+  while (n > 6) {
+    byte best = 0xFF;
+    for (i = 0; i < n; i++) {
+      for (j = i + 1; j < n; j++) {
+        byte cost = countBits(all | loose[i] | loose[j] | (base[i] ^ base[j]));
+        if (cost < best) {
+          best = cost;
+          best_i = i;
+          best_j = j;
+        }
+      }
+    }
+    loose[best_i] |= loose[best_j] | (base[best_i] ^ base[best_j]);
+    all |= loose[best_i];
+    n--;
+    base[best_j] = base[n];
+    loose[best_j] = loose[n];
+  }
+
+  //Choose one or two groups for RXB0, the others go to RXB1
+  uint16_t best = 0xFFFF;
+  for (i = 0; i < n; i++) {
+    for (j = i; j < n; j++) {
+      byte in0 = (i == j) ? 1 : 2;
+      if (n - in0 > 4) continue;
+      uint16_t l0 = loose[i] | loose[j];
+      uint16_t l1 = 0;
+      for (byte k = 0; k < n; k++) {
+        if (k != i && k != j) l1 |= loose[k];
+      }
+      uint16_t passed = ((uint16_t) in0 << countBits(l0)) + ((uint16_t) (n - in0) << countBits(l1));
+      if (passed < best) {
+        best = passed;
+        best_i = i;
+        best_j = j;
+        mask0 = l0;
+        mask1 = l1;
+      }
+    }
+  }
+
+  unsigned long masks[2] = {(unsigned long) (~mask0 & 0x7FF) << 16, (unsigned long) (~mask1 & 0x7FF) << 16};
+  unsigned long filters[6];
+  filters[0] = (unsigned long) base[best_i] << 16;
+  filters[1] = (unsigned long) base[best_j] << 16;
+  for (i = 0, j = 2; i < n; i++) {
+    if (i != best_i && i != best_j) filters[j++] = (unsigned long) base[i] << 16;
+  }
+  if (j == 2) {                               // all in RXB0, RXB1 gets the same
+    masks[1] = masks[0];
+    filters[j++] = filters[0];
+    filters[j++] = filters[1];
+  }
+  for (i = 2; j < 6; j++, i++) {              // fill unused filters
+    filters[j] = filters[i];
+  }
+  myCAN0->setFilterSet(masks, filters);
+  return (mask0 | mask1) == 0;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Set filters to the response IDs of all ECUs, used by queued requests
+//--------------------------------------------------------------------------------
+void canDiag::setCAN_Filter_Diag(){
+  uint16_t list[FILTER_MAX_IDS];
+  if (fLent) return;
+  for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+    list[ecu] = pgm_read_word(&kECU_ID[ecu][1]);
+  }
+  byte count = this->addBackgroundIDs(list, ECU_COUNT);
+  this->setCAN_Filters(list, count);
+  bgFiltered = (bgBMS != NULL);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Program the filters for the messages of a dispatch table that carry
+//! \brief   one of the given fields
+//! \param   dispatch table in PROGMEM (CANdispatch_t*), count of entries, 
+//! \param   bit per wanted field
+//! \return  only these messages pass the filters (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::setCAN_Filters(const CANdispatch_t *table, byte entries, byte fields) {
+  uint16_t list[FILTER_MAX_IDS];
+  byte count = 0;
+  for (byte i = 0; i < entries && count < FILTER_MAX_IDS; i++) {
+    if (bitRead(fields, pgm_read_byte(&table[i].field))) {
+      list[count++] = pgm_read_word(&table[i].ID);
+    }
+  }
+  return this->setCAN_Filters(list, count);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Set filters to the broadcast IDs of drivetrain data
+//--------------------------------------------------------------------------------
 void canDiag::setCAN_Filter_DRV(){
-  myCAN0->init_Mask(0, 0, 0x07FF0000);
-  myCAN0->init_Mask(1, 0, 0x07FF0000);
-  myCAN0->init_Filt(0, 0, (0x2000000));
-  myCAN0->init_Filt(1, 0, (0x3180000));
-  myCAN0->init_Filt(2, 0, (0x3CE0000));
-  myCAN0->init_Filt(3, 0, (0x3F20000));
-  myCAN0->init_Filt(4, 0, (0x3D70000));
-  myCAN0->init_Filt(5, 0, (0x5040000));
-  //delay(100);
-  myCAN0->setMode(MCP_NORMAL);                     // Set operation mode to normal so the MCP2515 sends acks to received data.
+  this->setCAN_Filters(kDRV_DISPATCH, ENTRIES(kDRV_DISPATCH), DRV_ALL);
 }
 
 //--------------------------------------------------------------------------------
 //! \brief   Set request CAN ID and response CAN ID for get functions
 //--------------------------------------------------------------------------------
 void canDiag::setCAN_ID(unsigned long _respID) {
+  if (fLent) return;
   if(this->respID != _respID) {
-    this->setCAN_Filter(_respID);
+    if (fQueued) this->setCAN_Filter_Diag(); else this->setCAN_Filter(_respID);
   }
   this->respID = _respID;
 }
 void canDiag::setCAN_ID(unsigned long _rqID, unsigned long _respID) {
   rqID = _rqID;
+  if (fLent) return;
   if(this->respID != _respID) {
-    this->setCAN_Filter(_respID);
+    if (fQueued) this->setCAN_Filter_Diag(); else this->setCAN_Filter(_respID);
   }
   this->respID = _respID; 
 }
@@ -173,156 +428,678 @@ boolean canDiag::WakeUp(){
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Send diagnostic request to ECU.
-//! \param   byte* rqQuery
-//! \see     rqBattADCref ... rqBattVolts
-//! \return  received lines count (uint16_t) of function #Get_RequestResponse
+//! \brief   Get ECU index of a request CAN ID
+//! \return  ECU (ECU_t), ECU_COUNT if unknown
 //--------------------------------------------------------------------------------
-uint16_t canDiag::Request_Diagnostics(const byte* rqQuery){  
+byte canDiag::getECU(unsigned long _rqID) {
+  switch (_rqID) {
+    case 0x7E7: return ECU_BMS;
+    case 0x61A: return ECU_NLG6;
+    case 0x7E5: return ECU_CLS;
+  }
+  return ECU_COUNT;
+}
 
-  byte rqMsg[8] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-  
-  // Detect skip data mode; size of request standard 4 parameter; skip enable (start param 5, stop param 6)
-  if (SkipEnable) {
-    //Copy request from prog memory with skip start and end
-    memcpy_P(rqMsg, rqQuery, 6 * sizeof(byte)); // Fill byte 01 to 04 of rqMsg with rqQuery content (from PROGMEM)
-    SkipStart = rqMsg[4];
-    SkipEnd = rqMsg[5];
-    rqMsg[4] = 0xFF; rqMsg[5] = 0xFF; // mark elements 5, 6 as unused data for correct query 
-    //Serial.print("> "); Serial.print(SkipStart); Serial.print(" > "); Serial.println(SkipEnd);
+//--------------------------------------------------------------------------------
+//! \brief   Find the ECUs on the bus: tester present is sent to all known ECUs
+//! \brief   in one burst, answers are collected within one time window
+//! \param   time window in ms (uint16_t)
+//! \return  bit per ECU that answered (ECU_t)
+//--------------------------------------------------------------------------------
+byte canDiag::discoverECUs(uint16_t window) {
+  byte rqTesterPresent[8] = {0x02, 0x3E, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  byte present = 0;
+  byte ecu;
+
+  this->setCAN_Filter_Diag();
+  this->respID = 0;                           // filters are set again by the next request
+  this->ClearReadBuffer();
+  for (ecu = 0; ecu < ECU_COUNT; ecu++) {
+    myCAN0->sendMsgBuf(pgm_read_word(&kECU_ID[ecu][0]), 0, 8, rqTesterPresent);
+  }
+
+  unsigned long tStart = millis();
+  while (millis() - tStart < window && present != (1 << ECU_COUNT) - 1) {
+    while(myCAN0->readMsgBuf(&rxID, &len, rxBuf) == CAN_OK) {   // frames received by interrupt
+      for (ecu = 0; ecu < ECU_COUNT; ecu++) {
+        //Positive or negative response, both tell the ECU is there
+        if (rxID == pgm_read_word(&kECU_ID[ecu][1]) && (rxBuf[1] == 0x7E || rxBuf[1] == 0x7F)) {
+          bitSet(present, ecu);
+        }
+      }
+    }
+    if (onIdle) onIdle();
+  }
+  return present;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Set / get flow control parameters used for multi-frame responses
+//! \param   ECU index (ECU_t), block size (byte), STmin in ms (byte)
+//--------------------------------------------------------------------------------
+void canDiag::setFlowControl(byte ecu, byte BS, byte STmin) {
+  if (ecu < ECU_COUNT) {
+    FCprofile[ecu].BS = BS;
+    FCprofile[ecu].STmin = STmin;
+  }
+}
+
+FlowControl_t canDiag::getFlowControl(byte ecu) {
+  return FCprofile[ecu];
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Time a multi-frame readout of an ECU with given flow control parameters
+//! \brief   BMS: capacity and voltage data, charger: amps, cooling: temperature
+//! \param   ECU index (ECU_t), block size (byte), STmin in ms (byte)
+//! \return  duration in ms, 0 if frames were lost or no multi-frame response
+//--------------------------------------------------------------------------------
+unsigned long canDiag::probeFlowControl(byte ecu, byte BS, byte STmin) {
+  FlowControl_t saved = FCprofile[ecu];
+  this->setFlowControl(ecu, BS, STmin);
+
+  unsigned long start = millis();
+  uint16_t seqErrors = seqErrorCount;
+  uint16_t retries = retryCount;
+  boolean fOK = false;
+  switch (ecu) {
+    case ECU_BMS:
+      this->setCAN_ID(0x7E7, 0x7EF);
+      this->setWindows(wnBattCapacity, sizeof(wnBattCapacity) / sizeof(DataWindow_t));
+      fOK = (this->Request_Diagnostics(rqBattCapacity) > 1);
+      if (fOK) {
+        this->setWindows(wnBattVolts, sizeof(wnBattVolts) / sizeof(DataWindow_t));
+        fOK = (this->Request_Diagnostics(rqBattVolts) > 1);
+      }
+      break;
+    case ECU_NLG6:
+      this->setCAN_ID(0x61A, 0x483);
+      fOK = (this->Request_Diagnostics(rqChargerAmps) > 1);
+      break;
+    case ECU_CLS:
+      this->setCAN_ID(0x7E5, 0x7ED);
+      fOK = (this->Request_Diagnostics(rqCoolingTemp) > 1);
+      break;
+  }
+  unsigned long duration = millis() - start;
+
+  //A response complete only after a retry lost frames with this setting
+  if (seqErrorCount != seqErrors || retryCount != retries) fOK = false;
+
+  FCprofile[ecu] = saved;
+  if (fOK) {
+    return (duration > 0) ? duration : 1;
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get status of negative responses (NRC) to diagnostic requests
+//--------------------------------------------------------------------------------
+boolean canDiag::NRCreceived() {
+  return (lastNRC.code != 0);
+}
+
+const DiagNRC_t* canDiag::getLastNRC() {
+  return &lastNRC;
+}
+
+uint16_t canDiag::getNRCcount() {
+  return NRC_count;
+}
+
+unsigned long canDiag::getNRCsavedTime() {
+  return NRC_savedTime;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get count of multi frame responses with lost consecutive frames
+//! \return  count since startup (uint16_t)
+//--------------------------------------------------------------------------------
+uint16_t canDiag::getSeqErrorCount() {
+  return seqErrorCount;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get count of requests sent again after lost consecutive frames
+//! \return  count since startup (uint16_t)
+//--------------------------------------------------------------------------------
+uint16_t canDiag::getRetryCount() {
+  return retryCount;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Register callbacks of the ISO-TP state machine
+//! \brief   onComplete: request finished, called with the received lines count
+//! \brief   (0 on timeout or negative response)
+//! \brief   onIdle: called while a blocking request waits for the bus
+//! \brief   onFrame: called with every received frame not part of a request
+//--------------------------------------------------------------------------------
+void canDiag::setCompleteCallback(void (*_onComplete)(uint16_t lines)) {
+  onComplete = _onComplete;
+}
+
+void canDiag::setIdleCallback(void (*_onIdle)()) {
+  onIdle = _onIdle;
+}
+
+void canDiag::setFrameCallback(void (*_onFrame)(unsigned long id, byte len, byte *buf)) {
+  onFrame = _onFrame;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Session used for requests to an ECU, unknown ECUs share the BMS session
+//--------------------------------------------------------------------------------
+IsoTpSession_t* canDiag::getSession(unsigned long _rqID) {
+  byte ecu = this->getECU(_rqID);
+  return &session[(ecu < ECU_COUNT) ? ecu : (byte) ECU_BMS];
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Status of a session
+//! \return  waiting for a response (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::isBusy(IsoTpSession_t *s) {
+  return (s->state == ISOTP_WAIT_FIRST || s->state == ISOTP_WAIT_CF);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Copy request from PROGMEM and fill up for UDS request size of 8 bytes
+//! \param   message (byte*), byte* rqQuery
+//--------------------------------------------------------------------------------
+void canDiag::buildRequest(byte *rqMsg, const byte* rqQuery) {
+  memset(rqMsg, 0xFF, 8);
+  memcpy_P(rqMsg, rqQuery, 4 * sizeof(byte)); // Fill byte 01 to 04 of rqMsg with rqQuery content (from PROGMEM)
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Send a request on a session and start waiting for the response
+//! \param   session (IsoTpSession_t*), message (byte*)
+//--------------------------------------------------------------------------------
+void canDiag::sendRequest(IsoTpSession_t *s, byte* rqMsg) {
+  //Use flow control parameters of the addressed ECU
+  byte ecu = this->getECU(s->rqID);
+  if (ecu < ECU_COUNT) {
+    s->BS = FCprofile[ecu].BS;
+    s->STmin = FCprofile[ecu].STmin;
   } else {
-    //Copy request from prog memory and fill up for UDS request size of 8 parameters
-    memcpy_P(rqMsg, rqQuery, 4 * sizeof(byte)); // Fill byte 01 to 04 of rqMsg with rqQuery content (from PROGMEM)
+    s->BS = FC_BS_DEFAULT;
+    s->STmin = FC_STMIN_DEFAULT;
   }
 
-  myCAN_Timeout->Reset();                     // Reset Timeout-Timer
+  s->length = 0;
+  s->rspLength = 0;
+  s->lines = 0;
+  s->state = ISOTP_WAIT_FIRST;
+  s->tLast = millis();
   
   //digitalWrite(CS_SD, HIGH);                // Disable SD card, or other SPI devices if nessesary
   
   //--- Diag Request Message ---
   DEBUG_UPDATE(F("Send Diag Request\n\r"));
-  myCAN0->sendMsgBuf(rqID, 0, 8, rqMsg);      // send data: Request diagnostics data
-  
-  return this->Get_RequestResponse();         // wait for response of first frame
+  myCAN0->sendMsgBuf(s->rqID, 0, 8, rqMsg);   // send data: Request diagnostics data
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Wait and read initial diagnostic response
-//! \return  lines count (uint16_t) of received lines á 7 bytes
+//! \brief   Send flow control frame with the parameters of the session
+//! \param   session (IsoTpSession_t*), flow status: 0x30 continue, 0x32 overflow
 //--------------------------------------------------------------------------------
-uint16_t canDiag::Get_RequestResponse(){ 
-    
-    byte i;
-    uint16_t items = 0;   
-    boolean fDataOK = false;
-    
-    do{
-      //--- Read Frames ---
-      if(!digitalRead(2))                         // If pin 2 is LOW, read receive buffer
-      {
-        do{
-          myCAN0->readMsgBuf(&rxID, &len, rxBuf);    // Read data: len = data length, buf = data byte(s)       
-          
-          if (rxID == this->respID) { 
-            if(rxBuf[0] < 0x10) {
-              if((rxBuf[1] != 0x7F)) {  
-                for (i = 0; i<len; i++) {         // read data bytes: offset +1, 1 to 7
-                    data[i] = rxBuf[i+1];       
-                }
-                DEBUG_UPDATE(F("SF reponse: "));
-                DEBUG_UPDATE(rxBuf[0] & 0x0F); DEBUG_UPDATE("\n\r");
-                items = 0;
-                fDataOK = true;
-              } else if (rxBuf[3] == 0x78) {
-                DEBUG_UPDATE(F("pending reponse...\n\r"));
-              } else {
-                DEBUG_UPDATE(F("ERROR\n\r"));
-              }
-            }
-            if ((rxBuf[0] & 0xF0) == 0x10){
-              items = combine_bytes(rxBuf[0], rxBuf[1]) & 0x0FFF; // six data bytes already read (+ two type and length)
-              for (i = 0; i<len; i++) {                 // read data bytes: offset +1, 1 to 7
-                  data[i] = rxBuf[i+1];       
-              }
-              //--- send rqFC: Request for more data ---
-              myCAN0->sendMsgBuf(this->rqID, 0, 8, rqFlowControl);
-              DEBUG_UPDATE(F("Resp, i:"));
-              DEBUG_UPDATE(items - 6); DEBUG_UPDATE("\n\r");
-              fDataOK = Read_FC_Response(items - 6);
-            } 
-          }     
-        } while(!digitalRead(2) && !myCAN_Timeout->Expired(false) && !fDataOK);
-      }
-    } while (!myCAN_Timeout->Expired(false) && !fDataOK);
+void canDiag::sendFlowControl(IsoTpSession_t *s, byte flowStatus) {
+  byte rqFC[8] = {flowStatus, s->BS, s->STmin, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+  myCAN0->sendMsgBufAsync(s->rqID, 0, 8, rqFC); // keep receiving while the frame goes out
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Send diagnostic request to ECU and start the ISO-TP state machine.
+//! \brief   The response is collected by calling #poll until #isDone.
+//! \brief   A queued request running on the same ECU is dropped.
+//! \param   byte* rqQuery
+//! \see     rqBattADCref ... rqBattVolts
+//--------------------------------------------------------------------------------
+void canDiag::beginRequest(const byte* rqQuery){  
+  byte rqMsg[8];
+  this->buildRequest(rqMsg, rqQuery);
+  this->beginMessage(rqMsg);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Send a diagnostic message from RAM and start the ISO-TP state machine
+//! \param   message (byte*), 8 bytes
+//--------------------------------------------------------------------------------
+void canDiag::beginMessage(byte* rqMsg){  
+  IsoTpSession_t *s = this->getSession(rqID);
+  s->rqID = rqID;
+  s->respID = respID;
+  s->buf = data;
+  s->room = DATALENGTH;
+
+  //Remember request for a possible negative response
+  lastNRC.code = 0;
+  lastNRC.service = rqMsg[1];
+  lastNRC.DID = combine_bytes(rqMsg[2], rqMsg[3]);
+  lastNRC.ECU = rqID;
+
+  fgSession = s;
+  fgActive = true;
+  rqLines = 0;
+  myCAN_Timeout->Reset();                     // Reset Timeout-Timer
+  this->sendRequest(s, rqMsg);
+}
 
-    this->SkipEnable = false;
+//--------------------------------------------------------------------------------
+//! \brief   Process received frames and timeouts of all running requests, 
+//! \brief   send queued requests of idle sessions,
+//! \brief   returns immediately if no frame is waiting.
+//! \return  request started by #beginRequest finished (boolean), see #isDone
+//--------------------------------------------------------------------------------
+boolean canDiag::poll() {
+  byte ecu;
+  IsoTpSession_t *s;
 
-    if (fDataOK) {
-      DEBUG_UPDATE(F("success!\n\r"));
-      return (items + 7) / 7;
+  while(myCAN0->readMsgBuf(&rxID, &len, rxBuf) == CAN_OK) {     // len = data length, buf = data byte(s)
+    for (ecu = 0; ecu < ECU_COUNT; ecu++) {
+      if (rxID == session[ecu].respID && this->isBusy(&session[ecu])) break;
+    }
+    if (ecu < ECU_COUNT) {
+      this->handleFrame(&session[ecu]);
     } else {
-      DEBUG_UPDATE(F("Event Timeout!\n\r")); 
-      this->ClearReadBuffer(); 
-      return 0; 
-    } 
+      this->decodeBackground();
+      if (onFrame) onFrame(rxID, len, rxBuf);
+    }
+  }
+  for (ecu = 0; ecu < ECU_COUNT; ecu++) {
+    s = &session[ecu];
+    if (this->isBusy(s)) {
+      if (fgActive && s == fgSession) {
+        if (myCAN_Timeout->Expired(false)) {
+          DEBUG_UPDATE(F("Event Timeout!\n\r"));
+          this->expireRequest(s);
+        }
+      } else if (millis() - s->tLast > DIAG_QUEUE_TIMEOUT) {
+        this->expireRequest(s);
+      }
+    } else if (s->next < s->count && !(fgActive && s == fgSession)) {
+      this->sendNext(s);
+    }
+  }
+  return this->isDone();
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Read remaining data and sent corresponding Flow Control frames
-//! \param   items still to read (int)
-//! \return  fDiagOK (boolean)
+//! \brief   Status of the ISO-TP state machine
+//! \return  request started by #beginRequest finished (boolean)
 //--------------------------------------------------------------------------------
-boolean canDiag::Read_FC_Response(int16_t items){   
-    myCAN_Timeout->Reset();
-    
-    byte i;
-    int16_t n = 7;
-    uint16_t rspLine = 0;
-    int16_t FC_count = 0;
-    byte FC_length = rqFlowControl[1];
-    boolean fDiagOK = false;
-    
-    do{
-      //--- Read Frames ---
-      if(!digitalRead(2))                         // If pin 2 is LOW, read receive buffer
-      {
-        do{
-          myCAN0->readMsgBuf(&rxID, &len, rxBuf);    // Read data: len = data length, buf = data byte(s)       
-          if((rxBuf[0] & 0xF0) == 0x20){
-            FC_count++;
-            items = items - len + 1;
-            for(i = 0; i<len; i++) {              // copy each byte of the rxBuffer to data-field
-              if ((n < (DATALENGTH - 6)) && (i < 7)){
-                data[n+i] = rxBuf[i+1];
-              }       
-            }
-            //--- FC counter -> then send Flow Control Message ---
-            if (FC_count % FC_length == 0 && items > 0) {
-              // send rqFC: Request for more data
-              myCAN0->sendMsgBuf(this->rqID, 0, 8, rqFlowControl);
-              DEBUG_UPDATE(F("FCrq\n\r"));
-            }
-            //--- Skip read data by using a write pointer (n) and a line counter (rspLine)
-            if (this->SkipEnable && (rspLine + 1) >= this->SkipStart && (rspLine + 1) <= this->SkipEnd) {
-              rspLine = rspLine + 1; 
-            } else {
-              rspLine = rspLine + 1;
-              n = n + 7;              
-            }
-          }      
-        } while(!digitalRead(2) && !myCAN_Timeout->Expired(false) && items > 0);
+boolean canDiag::isDone() {
+  return !fgActive;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Result of the last request
+//! \return  lines count (uint16_t) of received lines á 7 bytes, 0 on timeout
+//! \return  or negative response (see #lastNRC)
+//--------------------------------------------------------------------------------
+uint16_t canDiag::getResponseLines() {
+  return rqLines;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Send diagnostic request to ECU and wait for the complete response.
+//! \brief   Responses of queued requests are used if available.
+//! \param   byte* rqQuery
+//! \see     rqBattADCref ... rqBattVolts
+//! \return  received lines count (uint16_t), 0 on failure
+//--------------------------------------------------------------------------------
+uint16_t canDiag::Request_Diagnostics(const byte* rqQuery){  
+  if (fLent) return 0;
+  IsoTpSession_t *s = this->getSession(rqID);
+  byte k = this->findQueued(s, rqQuery);
+
+  //Wait for the queued request, then for the session to become idle
+  while (k < s->count && (s->next <= k || (s->next == k + 1 && this->isBusy(s)))) {
+    this->poll();
+    if (onIdle) onIdle();
+  }
+  if (k < s->count && this->getQueued(s, k, rqQuery)) {
+    windowCount = 0;
+    streamAvg = NULL;
+    return rqLines;
+  }
+
+  byte rqMsg[8];
+  this->buildRequest(rqMsg, rqQuery);
+  return this->Request_Message(rqMsg);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Send diagnostic message from RAM and wait for the complete response.
+//! \brief   A response with lost consecutive frames is requested again, up to 
+//! \brief   #DIAG_RETRIES times.
+//! \param   message (byte*), 8 bytes
+//! \return  received lines count (uint16_t), 0 on failure
+//--------------------------------------------------------------------------------
+uint16_t canDiag::Request_Message(byte* rqMsg){  
+  if (fLent) return 0;
+  IsoTpSession_t *s = this->getSession(rqID);
+  while (this->isBusy(s)) {
+    this->poll();
+    if (onIdle) onIdle();
+  }
+
+  //Windows and stream are reset by finishRequest, keep them for a retry
+  const DataWindow_t *_windowList = windowList;
+  byte _windowCount = windowCount;
+  Average *_streamAvg = streamAvg;
+  byte _streamCount = streamCount;
+  byte retry = 0;
+  do {
+    if (retry > 0) {
+      DEBUG_UPDATE(F("Retry\n\r"));
+      retryCount++;
+      this->setWindows(_windowList, _windowCount);
+      if (_streamAvg) _streamAvg->clear();
+      streamAvg = _streamAvg;
+      streamCount = _streamCount;
+    }
+    this->beginMessage(rqMsg);
+    while (!this->poll()) {
+      if (onIdle) onIdle();
+    }
+  } while (s->state == ISOTP_SEQ_ERROR && retry++ < DIAG_RETRIES);
+  return rqLines;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Finish running request of a session and report the result
+//! \param   session (IsoTpSession_t*), final state (IsoTpState_t)
+//--------------------------------------------------------------------------------
+void canDiag::finishRequest(IsoTpSession_t *s, byte state) {
+  s->state = state;
+  if (state == ISOTP_DONE) {
+    DEBUG_UPDATE(F("success!\n\r"));
+    s->lines = (s->length + 7) / 7;
+  } else {
+    s->lines = 0;
+  }
+  //Drop left over frames of this response, if no other request is waiting for frames
+  if (state == ISOTP_TIMEOUT || state == ISOTP_SEQ_ERROR || state == ISOTP_OVERFLOW || (state == ISOTP_DONE && s->length > 0)) {
+    byte busy = 0;
+    for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+      if (this->isBusy(&session[ecu])) busy++;
+    }
+    if (busy == 0) this->dropResponses(s->respID);
+  }
+  if (fgActive && s == fgSession) {
+    fgActive = false;
+    windowCount = 0;
+    streamAvg = NULL;
+    rqLines = s->lines;
+    if (onComplete) onComplete(rqLines);
+  } else {
+    this->storeQueued(s, state);
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Finish a request that timed out. Missing consecutive frames count
+//! \brief   as lost frames like a sequence error, the response is requested again.
+//! \param   session (IsoTpSession_t*)
+//--------------------------------------------------------------------------------
+void canDiag::expireRequest(IsoTpSession_t *s) {
+  if (s->state == ISOTP_WAIT_CF) {
+    seqErrorCount++;
+    this->finishRequest(s, ISOTP_SEQ_ERROR);
+  } else {
+    this->finishRequest(s, ISOTP_TIMEOUT);
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Evaluate a received frame of a session: single or first frame of 
+//! \brief   the response, consecutive frames with the corresponding Flow Control
+//--------------------------------------------------------------------------------
+void canDiag::handleFrame(IsoTpSession_t *s) {
+  byte i;
+  boolean fForeground = (fgActive && s == fgSession);
+
+  s->tLast = millis();
+  if (s->state == ISOTP_WAIT_FIRST) {
+    if(rxBuf[0] < 0x10) {
+      if((rxBuf[1] != 0x7F)) {  
+        for (i = 0; i<len && i < s->room; i++) { // read data bytes: offset +1, 1 to 7
+            s->buf[i] = rxBuf[i+1];       
+        }
+        DEBUG_UPDATE(F("SF reponse: "));
+        DEBUG_UPDATE(rxBuf[0] & 0x0F); DEBUG_UPDATE("\n\r");
+        s->length = 0;
+        s->rspLength = rxBuf[0] & 0x0F;
+        this->finishRequest(s, ISOTP_DONE);
+      } else if (rxBuf[3] == 0x78) {
+        DEBUG_UPDATE(F("pending reponse...\n\r"));
+      } else {
+        //--- Negative response: stop waiting, the ECU won't answer ---
+        if (fForeground) {
+          lastNRC.service = rxBuf[2];
+          lastNRC.code = rxBuf[3];
+          NRC_savedTime += myCAN_Timeout->Remaining();
+        } else {
+          s->NRC = rxBuf[3];
+        }
+        NRC_count++;
+        DEBUG_UPDATE(F("NRC: ")); DEBUG_UPDATE(rxBuf[3], HEX); DEBUG_UPDATE("\n\r");
+        this->finishRequest(s, ISOTP_NRC);
       }
-    } while (!myCAN_Timeout->Expired(false) && items > 0);
-    if (!myCAN_Timeout->Expired(false)) {
-      fDiagOK = true;
-      DEBUG_UPDATE(F("Items left: ")); DEBUG_UPDATE(items); DEBUG_UPDATE("\n\r");
-      DEBUG_UPDATE(F("FC count: ")); DEBUG_UPDATE(FC_count); DEBUG_UPDATE("\n\r");
-    } else {
-      fDiagOK = false;
-      DEBUG_UPDATE(F("Event Timeout!\n\r"));
-    } 
-    this->ClearReadBuffer();   
-    return fDiagOK;
+    } else if ((rxBuf[0] & 0xF0) == 0x10){
+      s->length = combine_bytes(rxBuf[0], rxBuf[1]) & 0x0FFF;
+      s->rspLength = s->length;
+      //--- Length byte and data must fit, a cut response is never reported as complete
+      if (!(fForeground && windowCount) && s->length + 1 > s->room) {
+        DEBUG_UPDATE(F("Overflow: ")); DEBUG_UPDATE(s->length); DEBUG_UPDATE("\n\r");
+        this->sendFlowControl(s, 0x32);
+        this->finishRequest(s, ISOTP_OVERFLOW);
+        return;
+      }
+      if (fForeground && windowCount) {
+        for (i = 0; i < 7; i++) this->windowByte(i, rxBuf[i+1]);
+      } else {
+        for (i = 0; i<len && i < s->room; i++) { // read data bytes: offset +1, 1 to 7
+            s->buf[i] = rxBuf[i+1];       
+        }
+      }
+      if (fForeground) {
+        for (i = 0; i < 7; i++) this->streamByte(i, rxBuf[i+1]);
+      }
+      //--- send rqFC: Request for more data ---
+      this->sendFlowControl(s);
+      DEBUG_UPDATE(F("Resp, i:"));
+      DEBUG_UPDATE(s->length - 6); DEBUG_UPDATE("\n\r");
+      s->items = s->length - 6;               // six data bytes already read (+ two type and length)
+      s->pos = 7;
+      s->rspLine = 0;
+      s->FC_count = 0;
+      s->state = ISOTP_WAIT_CF;
+      if (fForeground) myCAN_Timeout->Reset();
+    }
+  } else if (s->state == ISOTP_WAIT_CF) {
+    if((rxBuf[0] & 0xF0) == 0x20){
+      //--- Check sequence number: drop a repeated frame, stop on a lost frame
+      byte SN = rxBuf[0] & 0x0F;
+      if (s->rspLine > 0 && SN == (s->rspLine & 0x0F)) {
+        DEBUG_UPDATE(F("CF repeated\n\r"));
+        return;
+      }
+      if (SN != ((s->rspLine + 1) & 0x0F)) {
+        DEBUG_UPDATE(F("CF lost, SN: ")); DEBUG_UPDATE(SN); DEBUG_UPDATE("\n\r");
+        seqErrorCount++;
+        this->finishRequest(s, ISOTP_SEQ_ERROR);
+        return;
+      }
+      if (fForeground) myCAN_Timeout->Reset(); // timeout between consecutive frames
+      s->FC_count++;
+      s->items = s->items - len + 1;
+      if (fForeground && windowCount) {
+        for (i = 0; i < len - 1 && i < 7; i++) this->windowByte(s->pos + i, rxBuf[i+1]);
+      } else {
+        for(i = 0; i<len; i++) {              // copy each byte of the rxBuffer to data-field
+          if ((s->pos + i < s->room) && (i < 7)){
+            s->buf[s->pos+i] = rxBuf[i+1];
+          }       
+        }
+      }
+      //--- Decode streamed values
+      if (fForeground) {
+        for (i = 0; i < len - 1 && i < 7; i++) this->streamByte(s->pos + i, rxBuf[i+1]);
+      }
+      //--- FC counter -> then send Flow Control Message ---
+      if (s->BS > 0 && s->FC_count % s->BS == 0 && s->items > 0) {
+        // send rqFC: Request for more data
+        this->sendFlowControl(s);
+        DEBUG_UPDATE(F("FCrq\n\r"));
+      }
+      s->rspLine = s->rspLine + 1;
+      s->pos = s->pos + 7;              
+      if (s->items <= 0) {
+        DEBUG_UPDATE(F("Items left: ")); DEBUG_UPDATE(s->items); DEBUG_UPDATE("\n\r");
+        DEBUG_UPDATE(F("FC count: ")); DEBUG_UPDATE(s->FC_count); DEBUG_UPDATE("\n\r");
+        this->finishRequest(s, ISOTP_DONE);
+      }
+    }
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Queue requests to an ECU, sent in the background while other ECUs
+//! \brief   are read. Responses are kept until #clearQueue and used by the
+//! \brief   get methods instead of a new request. Responses not fitting into
+//! \brief   the buffer are requested again when needed.
+//! \param   ECU index (ECU_t), charger or cooling, see #qNLG6, #qCLS
+//! \return  queue set up (boolean), false if out of memory
+//--------------------------------------------------------------------------------
+boolean canDiag::queueRequests(byte ecu) {
+  const byte* const* list;
+  byte count;
+  uint16_t size;
+  unsigned long _rqID, _respID;
+
+  if (fLent) return false;
+  switch (ecu) {
+    case ECU_NLG6:
+      list = qNLG6; count = sizeof(qNLG6) / sizeof(qNLG6[0]); size = QUEUE_LENGTH_NLG6;
+      _rqID = 0x61A; _respID = 0x483;
+      break;
+    case ECU_CLS:
+      list = qCLS; count = sizeof(qCLS) / sizeof(qCLS[0]); size = QUEUE_LENGTH_CLS;
+      _rqID = 0x7E5; _respID = 0x7ED;
+      break;
+    default:
+      return false;
+  }
+  IsoTpSession_t *s = &session[ecu];
+  if (s->store || this->isBusy(s)) return false;
+  if (_getFreeRam() < (int) size + 128) return false;
+  s->store = new byte[size];
+  s->size = size;
+  s->fill = 0;
+  s->list = list;
+  s->count = count;
+  s->next = 0;
+  s->rqID = _rqID;
+  s->respID = _respID;
+  s->state = ISOTP_IDLE;
+  if (!fQueued) {
+    fQueued = true;
+    this->setCAN_Filter_Diag();
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Release queued requests and their responses of all ECUs
+//--------------------------------------------------------------------------------
+void canDiag::clearQueue() {
+  for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+    IsoTpSession_t *s = &session[ecu];
+    if (s->store) {
+      delete[] s->store;
+      s->store = NULL;
+    }
+    if (this->isBusy(s) && !(fgActive && s == fgSession)) {
+      s->state = ISOTP_IDLE;
+    }
+    s->count = 0;
+    s->next = 0;
+  }
+  if (fQueued) {
+    fQueued = false;
+    this->respID = 0;                         // set filter again with next request
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Send next queued request of a session
+//--------------------------------------------------------------------------------
+void canDiag::sendNext(IsoTpSession_t *s) {
+  const byte* rqQuery = (const byte*) pgm_read_ptr(&s->list[s->next++]);
+  uint16_t used = s->fill + 2;                // two byte header: query index, lines
+  s->buf = s->store + used;
+  s->room = (s->size > used) ? s->size - used : 0;
+  s->NRC = 0;
+  byte rqMsg[8];
+  this->buildRequest(rqMsg, rqQuery);
+  this->sendRequest(s, rqMsg);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Keep response of a queued request: query index, lines count, data 
+//! \brief   lines á 7 bytes or NRC (lines := 0), nothing if the buffer is full
+//! \brief   or consecutive frames were lost
+//--------------------------------------------------------------------------------
+void canDiag::storeQueued(IsoTpSession_t *s, byte state) {
+  if (!s->store || s->next == 0) return;
+  if (state == ISOTP_SEQ_ERROR || state == ISOTP_OVERFLOW) return; // incomplete, requested again when needed
+  uint16_t size = (state == ISOTP_DONE) ? s->lines * 7 : 1;
+  if (s->room < size) return;
+  s->store[s->fill] = s->next - 1;
+  s->store[s->fill + 1] = s->lines;
+  if (state != ISOTP_DONE) s->buf[0] = s->NRC;
+  s->fill += size + 2;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get index of a query in the queue of a session
+//! \return  index (byte), count of queued queries if not found
+//--------------------------------------------------------------------------------
+byte canDiag::findQueued(IsoTpSession_t *s, const byte* rqQuery) {
+  byte k;
+  for (k = 0; k < s->count; k++) {
+    if ((const byte*) pgm_read_ptr(&s->list[k]) == rqQuery) break;
+  }
+  return k;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Copy kept response of a queued request to the data buffer
+//! \return  response available (boolean), see #rqLines and #lastNRC for result
+//--------------------------------------------------------------------------------
+boolean canDiag::getQueued(IsoTpSession_t *s, byte k, const byte* rqQuery) {
+  uint16_t p = 0;
+  while (p + 2 < s->fill) {
+    byte lines = s->store[p + 1];
+    if (s->store[p] == k) {
+      lastNRC.service = pgm_read_byte(rqQuery + 1);
+      lastNRC.DID = combine_bytes(pgm_read_byte(rqQuery + 2), pgm_read_byte(rqQuery + 3));
+      lastNRC.ECU = s->rqID;
+      if (lines) {
+        memcpy(data, s->store + p + 2, lines * 7);
+        lastNRC.code = 0;
+      } else {
+        lastNRC.code = s->store[p + 2];
+      }
+      rqLines = lines;
+      return true;
+    }
+    p += 2 + (lines ? lines * 7 : 1);
+  }
+  return false;
 }
 
 //--------------------------------------------------------------------------------
@@ -338,7 +1115,7 @@ void canDiag::PrintReadBuffer(uint16_t lines) {
     for(byte n = 0; n < 7; n++)               // Print each byte of the data.
     {
       pos = n + 7 * i;
-      if (pos <= DATALENGTH) {
+      if (pos < DATALENGTH) {
         if(data[pos] < 0x10)             // If data byte is less than 0x10, add a leading zero.
         {
           Serial.print(F("0"));
@@ -355,16 +1132,48 @@ void canDiag::PrintReadBuffer(uint16_t lines) {
 //! \brief   Cleanup after switching filters
 //--------------------------------------------------------------------------------
 boolean canDiag::ClearReadBuffer(){
-  if(!digitalRead(2)) {                        // still messages? pin 2 is LOW, clear the two rxBuffers by reading
-    for (byte i = 1; i <= 2; i++) {
-      myCAN0->readMsgBuf(&rxID, &len, rxBuf);
-    }
+  CAN_FRAME frame;
+  byte n = 0;
+  while (n < CAN_RX_RING && myCAN0->pop(frame) == CAN_OK) {  // still messages? empty the receive ring
+    n++;
+  }
+  if (n) {
     DEBUG_UPDATE(F("Buffer cleared!\n\r"));
     return true;
   }
   return false;
 }
 
+//--------------------------------------------------------------------------------
+//! \brief   Lend the response buffer (DATALENGTH bytes) to the sketch, e.g. 
+//! \brief   as storage of the bus monitor. Requests and sniff passes fail and
+//! \brief   the filters are kept until it is returned.
+//! \return  buffer (byte*), NULL if requests are running or queued
+//--------------------------------------------------------------------------------
+byte *canDiag::lendBuffer() {
+  if (fLent || fQueued || fgActive) return NULL;
+  fLent = true;
+  return data;
+}
+
+void canDiag::returnBuffer() {
+  fLent = false;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Drop left over frames of a finished response, broadcast frames
+//! \brief   received meanwhile are decoded like in #poll
+//! \param   response CAN ID (unsigned long)
+//--------------------------------------------------------------------------------
+void canDiag::dropResponses(unsigned long ID) {
+  byte n = 0;
+  while (n++ < CAN_RX_RING && myCAN0->readMsgBuf(&rxID, &len, rxBuf) == CAN_OK) {
+    if (rxID == ID) continue;
+    this->decodeBackground();
+    if (onFrame) onFrame(rxID, len, rxBuf);
+  }
+}
+
 //--------------------------------------------------------------------------------
 //! \brief   Store two byte data in temperature array
 //--------------------------------------------------------------------------------
@@ -375,20 +1184,55 @@ void canDiag::ReadBatteryTemperatures(BatteryDiag_t *myBMS, byte data_in[], uint
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Store two byte data in CellCapacity obj
+//! \brief   Keep only windows of the response of the next foreground request
+//! \brief   in the data buffer, see #DataWindow_t
+//! \param   windows in PROGMEM (DataWindow_t*), count of windows
 //--------------------------------------------------------------------------------
-void canDiag::ReadCellCapacity(byte data_in[], uint16_t highOffset, uint16_t length){
-  for(uint16_t n = 0; n < (length * 2); n = n + 2){
-    CellCapacity.push(combine_bytes(data_in[n + highOffset], data_in[n + highOffset + 1]));
+void canDiag::setWindows(const DataWindow_t *windows, byte count) {
+  windowList = windows;
+  windowCount = count;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Store one received byte if its position is part of a window
+//! \param   position in response (uint16_t), data byte
+//--------------------------------------------------------------------------------
+void canDiag::windowByte(uint16_t pos, byte value) {
+  DataWindow_t wn;
+  for (byte n = 0; n < windowCount; n++) {
+    memcpy_P(&wn, &windowList[n], sizeof(DataWindow_t));
+    if (pos >= wn.start && pos < wn.start + wn.length) {
+      if (wn.dest + (pos - wn.start) < DATALENGTH) {
+        data[wn.dest + (pos - wn.start)] = value;
+      }
+      return;
+    }
   }
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Store two byte data in CellVoltage obj
+//! \brief   Push two byte data of the next foreground request directly into an
+//! \brief   Average obj while the frames are received
+//! \param   Average obj, start of first high byte in data (uint16_t), values (byte)
 //--------------------------------------------------------------------------------
-void canDiag::ReadCellVoltage(byte data_in[], uint16_t highOffset, uint16_t length){
-  for(uint16_t n = 0; n < (length * 2); n = n + 2){
-    CellVoltage.push(combine_bytes(data_in[n + highOffset], data_in[n + highOffset + 1]));
+void canDiag::setStream(Average *avg, uint16_t highOffset, byte count) {
+  streamAvg = avg;
+  streamStart = highOffset;
+  streamCount = count;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Decode one received byte of the stream, the high byte is kept 
+//! \brief   across frame boundaries
+//! \param   position in response (uint16_t), data byte
+//--------------------------------------------------------------------------------
+void canDiag::streamByte(uint16_t pos, byte value) {
+  if (!streamAvg || streamCount == 0 || pos < streamStart) return;
+  if ((pos - streamStart) & 0x01) {
+    streamAvg->push(combine_bytes(streamHigh, value));
+    streamCount--;
+  } else {
+    streamHigh = value;
   }
 }
 
@@ -405,6 +1249,213 @@ void canDiag::ReadDiagWord(uint16_t data_out[], byte data_in[], uint16_t highOff
   }
 }
 
+//--------------------------------------------------------------------------------
+//! \brief   Read values described by a DID table, entries with the same 
+//! \brief   request are decoded from one response. Requests rejected by the 
+//! \brief   ECU (NRC) are skipped, a request without response stops reading.
+//! \param   DID table in PROGMEM (DiagDID_t*), count of entries, 
+//! \param   destination data structure, charger variant (DIDvariant_t),
+//! \param   enable verbose / debug output (boolean)
+//! \return  all requests answered (boolean), see #NRCreceived if rejected
+//--------------------------------------------------------------------------------
+boolean canDiag::ReadDIDs(const DiagDID_t *table, byte count, void *dest, byte variant, boolean debug_verbose) {
+  DiagDID_t did;
+  const byte *rq = NULL;
+  uint16_t items = 0;
+  boolean fOK = true;
+  DiagNRC_t NRC;
+  NRC.code = 0;
+  byte i = 0;
+
+  while (i < count) {
+    memcpy_P(&did, &table[i], sizeof(DiagDID_t));
+    if (did.rq != rq) {
+      byte done = this->ReadDIDbatch(table, count, i, dest, variant, debug_verbose);
+      if (done) {
+        i += done;
+        continue;
+      }
+      rq = did.rq;
+      items = this->Request_Diagnostics(rq);
+      if (items) {
+        if (debug_verbose) {
+          this->PrintReadBuffer(items);
+        }
+        this->learnDIDsize();
+      } else if (this->NRCreceived()) {
+        NRC = lastNRC;
+        fOK = false;
+      } else {
+        return false;
+      }
+    }
+    if (items && (did.variant == DID_ALL || did.variant == variant)) {
+      this->DecodeDID(&did, (byte*) dest);
+    }
+    i++;
+  }
+  if (NRC.code) {
+    lastNRC = NRC;                            // keep NRC visible for the caller
+  }
+  return fOK;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Read several small DIDs of a table with one multi-DID request.
+//! \brief   Only DIDs with known single frame response size are combined, an
+//! \brief   ECU rejecting the request is read by single DID requests from now on.
+//! \param   DID table in PROGMEM (DiagDID_t*), count of entries, first entry,
+//! \param   destination data structure, charger variant (DIDvariant_t),
+//! \param   enable verbose / debug output (boolean)
+//! \return  count of table entries read, 0 if not batched
+//--------------------------------------------------------------------------------
+byte canDiag::ReadDIDbatch(const DiagDID_t *table, byte count, byte i, void *dest, byte variant, boolean debug_verbose) {
+  byte ecu = this->getECU(rqID);
+  if (ecu >= ECU_COUNT || bitRead(DIDbatchRejected, ecu) || fQueued) return 0;
+
+  DiagDID_t did;
+  const byte *rq = NULL;
+  byte rqMsg[8];
+  byte size[DID_BATCH_MAX];
+  byte first[DID_BATCH_MAX + 1];            // first table entry of each DID
+  byte n = 0;
+  byte k;
+  uint16_t expected = 1;                    // positive response 0x62, DID and data
+
+  //Collect DIDs following each other with known size
+  memset(rqMsg, 0xFF, 8);
+  for (k = i; k < count; k++) {
+    memcpy_P(&did, &table[k], sizeof(DiagDID_t));
+    if (did.rq == rq) continue;
+    if (n == DID_BATCH_MAX) break;
+    byte q[4];
+    memcpy_P(q, did.rq, 4);
+    byte len = this->getDIDsize(combine_bytes(q[2], q[3]));
+    if (q[0] != 0x03 || q[1] != 0x22 || len == 0 || len > DID_BATCH_SIZE) break;
+    rq = did.rq;
+    rqMsg[2 + 2 * n] = q[2];
+    rqMsg[3 + 2 * n] = q[3];
+    size[n] = len;
+    first[n] = k;
+    expected += 2 + len;
+    n++;
+  }
+  first[n] = k;
+  if (n < 2) return 0;
+  rqMsg[0] = 1 + 2 * n;
+  rqMsg[1] = 0x22;
+
+  uint16_t items = this->Request_Message(rqMsg);
+
+  //Response must contain all DIDs in the order requested
+  IsoTpSession_t *s = this->getSession(rqID);
+  byte resp[1 + DID_BATCH_MAX * (2 + DID_BATCH_SIZE)];
+  byte hdr = (s->rspLength > 7) ? 1 : 0;    // first frame: data[0] holds length
+  byte j, p;
+  boolean fValid = (items && s->rspLength == expected && data[hdr] == 0x62);
+  if (fValid) {
+    memcpy(resp, data + hdr, expected);
+    for (j = 0, p = 1; j < n; p += 2 + size[j], j++) {
+      if (resp[p] != rqMsg[2 + 2 * j] || resp[p + 1] != rqMsg[3 + 2 * j]) fValid = false;
+    }
+  }
+  if (!fValid) {
+    //Only a refused request or a malformed reply is permanent, a timeout or
+    //another negative response is retried as single DIDs this time only
+    if (items || lastNRC.code == 0x13 || lastNRC.code == 0x31) {
+      DEBUG_UPDATE(F("Multi-DID rejected\n\r"));
+      bitSet(DIDbatchRejected, ecu);
+    }
+    return 0;
+  }
+  if (debug_verbose) {
+    this->PrintReadBuffer(items);
+  }
+
+  //Decode each DID from a single frame response layout: 0x62, DID, data
+  for (j = 0, p = 1; j < n; p += 2 + size[j], j++) {
+    data[0] = 0x62;
+    memcpy(data + 1, resp + p, 2 + size[j]);
+    for (k = first[j]; k < first[j + 1]; k++) {
+      memcpy_P(&did, &table[k], sizeof(DiagDID_t));
+      if (did.variant == DID_ALL || did.variant == variant) {
+        this->DecodeDID(&did, (byte*) dest);
+      }
+    }
+  }
+  lastNRC.code = 0;
+  return first[n] - i;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Remember response size of a DID read by a single frame request
+//--------------------------------------------------------------------------------
+void canDiag::learnDIDsize() {
+  IsoTpSession_t *s = this->getSession(rqID);
+  if (fQueued || s->rspLength < 4 || s->rspLength > 7 || data[0] != 0x62) return;
+  uint16_t DID = combine_bytes(data[1], data[2]);
+  if (this->getDIDsize(DID) == 0 && DIDsizeCount < DID_SIZE_CACHE) {
+    DIDsize[DIDsizeCount].DID = DID;
+    DIDsize[DIDsizeCount].size = s->rspLength - 3;
+    DIDsizeCount++;
+  }
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get response size of a DID
+//! \return  data bytes (byte), 0 if unknown
+//--------------------------------------------------------------------------------
+byte canDiag::getDIDsize(uint16_t DID) {
+  for (byte n = 0; n < DIDsizeCount; n++) {
+    if (DIDsize[n].DID == DID) return DIDsize[n].size;
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Status of multi-DID requests of an ECU
+//! \return  multi-DID requests not rejected (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::DIDbatching(byte ecu) {
+  return !bitRead(DIDbatchRejected, ecu);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Decode value(s) of a DID descriptor from the data buffer
+//! \param   descriptor (DiagDID_t*), destination data structure
+//--------------------------------------------------------------------------------
+void canDiag::DecodeDID(const DiagDID_t *did, byte *dest) {
+  byte *field = dest + did->field;
+  uint16_t value;
+
+  for (byte n = 0; n < did->count; n++) {
+    switch (did->type) {
+      case DID_U8:
+        field[n] = data[did->pos + n];
+        break;
+      case DID_U8W:
+        ((uint16_t*) field)[n] = data[did->pos + n];
+        break;
+      case DID_U16:
+        value = combine_bytes(data[did->pos + 2 * n], data[did->pos + 2 * n + 1]);
+        if (did->invalid && value == did->invalid) {
+          value = 0;
+        }
+        ((uint16_t*) field)[n] = value;
+        break;
+      case DID_U24:
+        ((unsigned long*) field)[n] = combine_bytes_3(data[did->pos + 3 * n], data[did->pos + 3 * n + 1], data[did->pos + 3 * n + 2]);
+        break;
+      case DID_OTR24:
+        ((unsigned long*) field)[n] = (combine_bytes_3(data[did->pos + 3 * n], data[did->pos + 3 * n + 1], data[did->pos + 3 * n + 2]) << 8) / 10.0;
+        break;
+      case DID_ZERO16:
+        ((uint16_t*) field)[n] = 0;
+        break;
+    }
+  }
+}
+
 //--------------------------------------------------------------------------------
 //! \brief   Read and evaluate battery temperatures (values / 64 in deg C)
 //! \param   enable verbose / debug output (boolean)
@@ -660,15 +1711,15 @@ boolean canDiag::getBatteryCapacity(BatteryDiag_t *myBMS, boolean debug_verbose)
   uint16_t items;
 
   this->setCAN_ID(0x7E7, 0x7EF);
-  this->SkipEnable = true;
+  this->setWindows(wnBattCapacity, sizeof(wnBattCapacity) / sizeof(DataWindow_t));
+  CellCapacity.clear();
+  this->setStream(&CellCapacity, 25, CELLCOUNT);
   items = this->Request_Diagnostics(rqBattCapacity);
   
   if(items){
     if (debug_verbose) {
       this->PrintReadBuffer(items);
     }   
-    CellCapacity.clear();
-    this->ReadCellCapacity(data,25,CELLCOUNT);
     myBMS->Ccap_As.min = CellCapacity.minimum(&myBMS->CAP_min_at);
     myBMS->Ccap_As.max = CellCapacity.maximum(&myBMS->CAP_max_at);
     myBMS->Ccap_As.mean = CellCapacity.mean();
@@ -680,14 +1731,15 @@ boolean canDiag::getBatteryCapacity(BatteryDiag_t *myBMS, boolean debug_verbose)
     this->ReadDiagWord(&myBMS->Cap_As.min,data,21,1);
     this->ReadDiagWord(&myBMS->Cap_As.mean,data,23,1);
     this->ReadDiagWord(&myBMS->Cap_As.max,data,17,1);
-    this->ReadDiagWord(&myBMS->LastMeas_days,data,224,1); 
+    this->ReadDiagWord(&myBMS->LastMeas_days,data,27,1); 
     uint16_t value;
-    this->ReadDiagWord(&value,data,226,1); 
+    this->ReadDiagWord(&value,data,29,1); 
     myBMS->Cap_meas_quality = value / 65535.0;
-    this->ReadDiagWord(&value,data,222,1); 
+    this->ReadDiagWord(&value,data,25,1); 
     myBMS->Cap_combined_quality = value / 65535.0;
     return true;
   } else {
+    CellCapacity.clear();
     return false;
   }
 }
@@ -755,21 +1807,22 @@ boolean canDiag::getBatteryVoltage(BatteryDiag_t *myBMS, boolean debug_verbose)
   uint16_t items;
 
   this->setCAN_ID(0x7E7, 0x7EF);
-  this->SkipEnable = true;
+  this->setWindows(wnBattVolts, sizeof(wnBattVolts) / sizeof(DataWindow_t));
+  CellVoltage.clear();
+  this->setStream(&CellVoltage, 4, CELLCOUNT);
   items = this->Request_Diagnostics(rqBattVolts);
   
   if(items){
     if (debug_verbose) {
       this->PrintReadBuffer(items);
     }   
-    CellVoltage.clear();
-    this->ReadCellVoltage(data,4,CELLCOUNT);
     myBMS->Cvolts.min = CellVoltage.minimum(&myBMS->CV_min_at);
     myBMS->Cvolts.max = CellVoltage.maximum(&myBMS->CV_max_at);
     myBMS->Cvolts.mean = CellVoltage.mean();
     myBMS->Cvolts_stdev = CellVoltage.stddev();
     return true;
   } else {
+    CellVoltage.clear();
     return false;
   }
 }
@@ -880,42 +1933,9 @@ boolean canDiag::getBatteryADCref(BatteryDiag_t *myBMS, boolean debug_verbose) {
 //--------------------------------------------------------------------------------
 boolean canDiag::getHVcontactorState(BatteryDiag_t *myBMS, boolean debug_verbose) {
   debug_verbose = debug_verbose & VERBOSE_ENABLE;
-  uint16_t items;
-  boolean fValid = false;
-  
-  this->setCAN_ID(0x7E7, 0x7EF);
-  items = this->Request_Diagnostics(rqBattHVContactorCyclesLeft);
-  
-  if(items){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }   
-    myBMS->HVcontactCyclesLeft = combine_bytes_3(data[4], data[5], data[6]); 
-    fValid = true;
-  } else {
-    fValid = false;
-  }
-  items = this->Request_Diagnostics(rqBattHVContactorMax);
-  if(items){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }   
-    myBMS->HVcontactCyclesMax = combine_bytes_3(data[4], data[5], data[6]); 
-    fValid = true;
-  } else {
-    fValid = false;
-  }
-  items = this->Request_Diagnostics(rqBattHVContactorState);
-  if(items){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }   
-    myBMS->HVcontactState = (uint16_t) data[3]; 
-    fValid = true;
-  } else {
-    fValid = false;
-  }
-  return fValid;
+  
+  this->setCAN_ID(0x7E7, 0x7EF);
+  return this->ReadDIDs(didHVcontactor, sizeof(didHVcontactor) / sizeof(DiagDID_t), myBMS, DID_ALL, debug_verbose);
 }
 
 //--------------------------------------------------------------------------------
@@ -969,18 +1989,8 @@ boolean canDiag::printNLG6ChargerSWrev(ChargerDiag_t *myNLG6, boolean debug_verb
        PrintReadBuffer(items);
     }
     byte n = 4; 
-    byte revCount = 0;
-    do {
-      if (n > 4 && (data[n] == 0x34 && data[n+1] == 0x35 && data[n+2] == 0x31)) {
-        Serial.print(F(", "));
-        revCount++;
-        if (revCount%3 == 0) {
-          Serial.println();
-        }
-      }
-      Serial.print((char)data[n]);
-    } while ((data[++n] != 0x0F) && (n < items * 7));
-    Serial.println();
+    while ((data[n] != 0x0F) && (n < items * 7) && (n < DATALENGTH)) n++;
+    this->printChargerSWrev(data + 4, n - 4);
     return true;
   } else {
     return false;
@@ -988,37 +1998,56 @@ boolean canDiag::printNLG6ChargerSWrev(ChargerDiag_t *myNLG6, boolean debug_verb
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Read and evaluate charger temperatures (values - 40 in deg C)
-//! \param   enable verbose / debug output (boolean)
-//! \return  report success (boolean)
+//! \brief   Get NLG6 SW revision as raw ASCII data, e.g. to keep it for later use
+//! \param   output buffer (byte*), size of buffer
+//! \return  length of revision data (byte), 0 on failure
 //--------------------------------------------------------------------------------
-boolean canDiag::getChargerTemperature(ChargerDiag_t *myNLG6, boolean debug_verbose) {
-  debug_verbose = debug_verbose & VERBOSE_ENABLE;
+byte canDiag::getChargerSWrev(byte *rev, byte size) {
   uint16_t items;
-  
+
   this->setCAN_ID(0x61A, 0x483);
-  items = this->Request_Diagnostics(rqChargerTemperatures);
+  items = this->Request_Diagnostics(rqChargerSWrev);
 
+  byte n = 0;
   if(items){
-    if (debug_verbose) {
-       PrintReadBuffer(items);
-    } 
-    if (myNLG6->NLG6present){
-      myNLG6->CoolingPlateTemp = data[4];
-      for(byte n = 0; n < 8; n++) {
-        myNLG6->Temps[n] = data[n + 5];
+    while ((data[n + 4] != 0x0F) && (n + 4 < items * 7) && (n + 4 < DATALENGTH) && (n < size)) {
+      rev[n] = data[n + 4];
+      n++;
+    }
+  }
+  return n;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Print NLG6 SW revision data, three part numbers per line
+//! \param   revision data (byte*), length of data
+//--------------------------------------------------------------------------------
+void canDiag::printChargerSWrev(const byte *rev, byte length) {
+  byte revCount = 0;
+  for (byte n = 0; n < length; n++) {
+    if (n > 0 && n + 2 < length && (rev[n] == 0x34 && rev[n+1] == 0x35 && rev[n+2] == 0x31)) {
+      Serial.print(F(", "));
+      revCount++;
+      if (revCount%3 == 0) {
+        Serial.println();
       }
-      myNLG6->ReportedTemp = data[12];
-      myNLG6->SocketTemp = data[13];
-    } else {
-      myNLG6->CoolingPlateTemp = data[5]; //5
-      myNLG6->ReportedTemp = data[7]; //7
-      myNLG6->SocketTemp = data[9]; //9
     }
-    return true;
-  } else {
-    return false;
+    Serial.print((char)rev[n]);
   }
+  Serial.println();
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Read and evaluate charger temperatures (values - 40 in deg C)
+//! \param   enable verbose / debug output (boolean)
+//! \return  report success (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::getChargerTemperature(ChargerDiag_t *myNLG6, boolean debug_verbose) {
+  debug_verbose = debug_verbose & VERBOSE_ENABLE;
+  byte variant = (myNLG6->NLG6present) ? DID_NLG6 : DID_OBL;
+
+  this->setCAN_ID(0x61A, 0x483);
+  return this->ReadDIDs(didChargerTemperatures, sizeof(didChargerTemperatures) / sizeof(DiagDID_t), myNLG6, variant, debug_verbose);
 }
 
 //--------------------------------------------------------------------------------
@@ -1028,24 +2057,10 @@ boolean canDiag::getChargerTemperature(ChargerDiag_t *myNLG6, boolean debug_verb
 //--------------------------------------------------------------------------------
 boolean canDiag::getChargerSelCurrent(ChargerDiag_t *myNLG6, boolean debug_verbose) {
   debug_verbose = debug_verbose & VERBOSE_ENABLE;
-  uint16_t items;
+  byte variant = (myNLG6->NLG6present) ? DID_NLG6 : DID_OBL;
 
   this->setCAN_ID(0x61A, 0x483);
-  items = this->Request_Diagnostics(rqChargerSelCurrent);
-  
-  if(items){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    } 
-    if(myNLG6->NLG6present){
-      myNLG6->Amps_setpoint = data[8]; //Get data for NLG6 fast charger
-    } else {
-      myNLG6->Amps_setpoint = data[7]; //7 //Get data for standard OBL
-    }
-    return true;
-  } else {
-    return false;
-  }
+  return this->ReadDIDs(didChargerSelCurrent, sizeof(didChargerSelCurrent) / sizeof(DiagDID_t), myNLG6, variant, debug_verbose);
 }
 
 //--------------------------------------------------------------------------------
@@ -1055,47 +2070,10 @@ boolean canDiag::getChargerSelCurrent(ChargerDiag_t *myNLG6, boolean debug_verbo
 //--------------------------------------------------------------------------------
 boolean canDiag::getChargerVoltages(ChargerDiag_t *myNLG6, boolean debug_verbose) {
   debug_verbose = debug_verbose & VERBOSE_ENABLE;
-  uint16_t items;
-  uint16_t value;
+  byte variant = (myNLG6->NLG6present) ? DID_NLG6 : DID_OBL;
 
   this->setCAN_ID(0x61A, 0x483);
-  items = this->Request_Diagnostics(rqChargerVoltages);
-  
-  if(items){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    } 
-    if (myNLG6->NLG6present){
-      myNLG6->LV = data[8];
-      this->ReadDiagWord(&value,data,9,1);
-      myNLG6->DC_HV = value;
-      this->ReadDiagWord(&value,data,11,1);
-      myNLG6->MainsVoltage[0] = value;
-      this->ReadDiagWord(&value,data,13,1);
-      myNLG6->MainsVoltage[1] = value;
-      this->ReadDiagWord(&value,data,15,1);
-      myNLG6->MainsVoltage[2] = value;
-    } else {
-      myNLG6->LV = data[6]; //6
-      this->ReadDiagWord(&value,data,9,1);
-      if (value != 8190) {  //OBL showing only valid data while charging
-        myNLG6->DC_HV = value;
-      } else {
-        myNLG6->DC_HV = 0;
-      }
-      this->ReadDiagWord(&value,data,11,1);
-      if (value != 8190) {  //OBL showing only valid data while charging
-        myNLG6->MainsVoltage[0] = value;
-      } else {
-        myNLG6->MainsVoltage[0] = 0;
-      }
-      myNLG6->MainsVoltage[1] = 0;
-      myNLG6->MainsVoltage[2] = 0;
-    }
-    return true;
-  } else {
-    return false;
-  }
+  return this->ReadDIDs(didChargerVoltages, sizeof(didChargerVoltages) / sizeof(DiagDID_t), myNLG6, variant, debug_verbose);
 }
 
 //--------------------------------------------------------------------------------
@@ -1105,54 +2083,10 @@ boolean canDiag::getChargerVoltages(ChargerDiag_t *myNLG6, boolean debug_verbose
 //--------------------------------------------------------------------------------
 boolean canDiag::getChargerAmps(ChargerDiag_t *myNLG6, boolean debug_verbose) {
   debug_verbose = debug_verbose & VERBOSE_ENABLE;
-  uint16_t items;
-  uint16_t value;
+  byte variant = (myNLG6->NLG6present) ? DID_NLG6 : DID_OBL;
 
   this->setCAN_ID(0x61A, 0x483);
-  items = this->Request_Diagnostics(rqChargerAmps);
-  
-  if(items){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    } 
-    if (myNLG6->NLG6present){
-      this->ReadDiagWord(&value,data,4,1);
-      myNLG6->DC_Current = value; 
-      this->ReadDiagWord(&value,data,6,1);
-      myNLG6->MainsAmps[0] = value;  
-      this->ReadDiagWord(&value,data,8,1);
-      myNLG6->MainsAmps[1] = value; 
-      this->ReadDiagWord(&value,data,10,1);
-      myNLG6->MainsAmps[2] = value; 
-      this->ReadDiagWord(&value,data,16,1);
-      myNLG6->AmpsChargingpoint = value; 
-      this->ReadDiagWord(&value,data,18,1);
-      myNLG6->AmpsCableCode = value;
-    } else {
-      this->ReadDiagWord(&value,data,6,1);
-      if (value != 2047) {  //OBL showing only valid data while charging
-        myNLG6->MainsAmps[0] = value; 
-
-      } else {
-        myNLG6->MainsAmps[0] = 0;
-      }
-      myNLG6->MainsAmps[1] = 0;
-      myNLG6->MainsAmps[2] = 0;
-      
-      this->ReadDiagWord(&value,data,18,1);
-      if (value != 2047) {  //OBL showing only valid data while charging
-        myNLG6->DC_Current = value; 
-      } else {
-        myNLG6->DC_Current = 0;
-      }
-      this->ReadDiagWord(&value,data,14,1); //Usable AmpsCode from Cable seem to be also a word with OBL as with NLG6?!
-      myNLG6->AmpsCableCode = value;
-      //myNLG6->AmpsCableCode = data[15]; //15
-    }
-    return true;
-  } else {
-    return false;
-  }
+  return this->ReadDIDs(didChargerAmps, sizeof(didChargerAmps) / sizeof(DiagDID_t), myNLG6, variant, debug_verbose);
 }
 
 //--------------------------------------------------------------------------------
@@ -1162,218 +2096,170 @@ boolean canDiag::getChargerAmps(ChargerDiag_t *myNLG6, boolean debug_verbose) {
 //--------------------------------------------------------------------------------
 boolean canDiag::getCoolingAndSubsystems(CoolingSub_t *myCLS, boolean debug_verbose) {
   debug_verbose = debug_verbose & VERBOSE_ENABLE;
-  uint16_t items;
-  uint16_t value;
-  unsigned long vpOTR;
-  //int16_t vpPress;
 
-  boolean fOK = false;
   this->setCAN_ID(0x7E5, 0x7ED);
-  
-  items = this->Request_Diagnostics(rqCoolingTemp);
-  if(items){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    this->ReadDiagWord(&value,data,3,1);
-    myCLS->CoolingTemp = value;
-    fOK = true;
-  }
-  items = this->Request_Diagnostics(rqCoolingPumpTemp);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    myCLS->CoolingPumpTemp = data[3];
-    fOK = true;
-  }
-  items = this->Request_Diagnostics(rqCoolingPumpLV);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    myCLS->CoolingPumpLV = data[3];
-    fOK = true;
-  }
-  items = this->Request_Diagnostics(rqCoolingPumpAmps);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    myCLS->CoolingPumpAmps = data[4];
-    fOK = true;
-  }
-  items = this->Request_Diagnostics(rqCoolingPumpRPM);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    myCLS->CoolingPumpRPM = data[3];
-    fOK = true;
-  }
-  items = this->Request_Diagnostics(rqCoolingPumpOTR);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    this->ReadDiagWord(&value,data,3,1);
-    myCLS->CoolingPumpOTR = value;
-    fOK = true;
-  }
-  items = this->Request_Diagnostics(rqCoolingFanRPM);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    myCLS->CoolingFanRPM = data[3];
-    fOK = true;
-  }
-  items = this->Request_Diagnostics(rqCoolingFanOTR);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    this->ReadDiagWord(&value,data,3,1);
-    myCLS->CoolingFanOTR = value;
-    fOK = true;
+  if (this->ReadDIDs(didCLS, sizeof(didCLS) / sizeof(DiagDID_t), myCLS, DID_ALL, debug_verbose)) {
+    return true;
   }
-  items = this->Request_Diagnostics(rqBatteryHeaterOTR);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    this->ReadDiagWord(&value,data,3,1);
-    myCLS->BatteryHeaterOTR = value;
-    fOK = true;
+  return this->NRCreceived();     //DIDs not supported, the others are valid
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Read CAN messages related to battery system, only one given ID 
+//! \brief   or all of them
+//! \return  report success (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::ReadCAN(BatteryDiag_t *myBMS, unsigned long _rxID) {
+  if (_rxID == 0) {
+    return this->SniffBMS(myBMS, SNIFF_ALL) == SNIFF_ALL;
   }
-  items = this->Request_Diagnostics(rqBatteryHeaterON);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    } 
-    myCLS->BatteryHeaterON = data[3];
-    fOK = true;
+  CANdispatch_t entry;
+  if (findDispatch(kBMS_DISPATCH, ENTRIES(kBMS_DISPATCH), _rxID, &entry)) {
+    return this->SniffBMS(myBMS, bit(entry.field)) != 0;
   }
-  items = this->Request_Diagnostics(rqVacuumPumpOTR);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    this->ReadDiagWord(&value,data,4,1);
-    vpOTR =  (combine_bytes_3(data[3], data[4], data[5]) << 8) / 10.0;
-    myCLS->VaccumPumpOTR = vpOTR;
-    fOK = true;
+  return false;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Read the wanted battery values from CAN traffic in one pass: the 
+//! \brief   filters take all needed IDs at once, the pass ends when every wanted
+//! \brief   field was seen or after one timeout
+//! \param   bit per wanted field (SniffField_t)
+//! \return  bit per field obtained (byte)
+//--------------------------------------------------------------------------------
+byte canDiag::SniffBMS(BatteryDiag_t *myBMS, byte wanted) {
+  byte needed = wanted;
+  if (bitRead(needed, SNIFF_POWER)) {
+    needed |= bit(SNIFF_AMPS) | bit(SNIFF_HV);   // power is calculated from both
+    bitClear(needed, SNIFF_POWER);
   }
-  items = this->Request_Diagnostics(rqVacuumPumpPress1);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
-    }
-    this->ReadDiagWord(&value,data,4,1);
-    myCLS->VaccumPumpPress1 = (int16_t) combine_bytes(data[3], data[4]);
-    fOK = true;
+  byte seen = this->Sniff(kBMS_DISPATCH, ENTRIES(kBMS_DISPATCH), myBMS, needed);
+  if (bitRead(seen, SNIFF_AMPS) && bitRead(seen, SNIFF_HV)) {
+    CalcPower(myBMS);
+    this->updateLatest(SNIFF_POWER);
+    bitSet(seen, SNIFF_POWER);
   }
-  items = this->Request_Diagnostics(rqVacuumPumpPress2);
-  if(items && fOK){
-    if (debug_verbose) {
-      this->PrintReadBuffer(items);
+  return seen & wanted;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Keep decoding BMS broadcast messages into the given data set while
+//! \brief   the sketch is idle or waits for diagnostic responses. The filters 
+//! \brief   let the broadcast IDs pass together with the diagnostic responses.
+//! \param   destination data set (BatteryDiag_t*), NULL to stop
+//--------------------------------------------------------------------------------
+void canDiag::setBackground(BatteryDiag_t *myBMS) {
+  bgBMS = myBMS;
+  bgFiltered = false;
+  this->background();
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Background sniffing, called from the main loop: filters are set 
+//! \brief   again if a sniff pass changed them, waiting frames are decoded
+//--------------------------------------------------------------------------------
+void canDiag::background() {
+  if (!bgBMS) return;
+  if (!bgFiltered) {
+    for (byte ecu = 0; ecu < ECU_COUNT; ecu++) {
+      if (this->isBusy(&session[ecu])) return;
     }
-    this->ReadDiagWord(&value,data,4,1);
-    myCLS->VaccumPumpPress2 = (int16_t) combine_bytes(data[3], data[4]);
-    fOK = true;
+    unsigned long _respID = respID;
+    this->setCAN_Filter_Diag();
+    this->respID = _respID;                   // all ECU responses pass, as with queued requests
   }
-  if(fOK){
-    return true;
-  } else {
+  this->poll();
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Decode the last received frame into the background data set
+//! \return  frame was a BMS broadcast message (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::decodeBackground() {
+  CANdispatch_t entry;
+  if (!bgBMS || !findDispatch(kBMS_DISPATCH, ENTRIES(kBMS_DISPATCH), rxID, &entry)) {
     return false;
   }
+  entry.decode(bgBMS, rxBuf);
+  this->updateLatest(entry.field);
+  if ((entry.field == SNIFF_AMPS || entry.field == SNIFF_HV) && !this->isStale(SNIFF_AMPS) && !this->isStale(SNIFF_HV)) {
+    CalcPower(bgBMS);
+    this->updateLatest(SNIFF_POWER);
+  }
+  return true;
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Read and evaluate CAN messages related to battery system
-//! \return  report success (boolean)
+//! \brief   Note the update of a sniffed BMS value
+//! \param   field (SniffField_t)
 //--------------------------------------------------------------------------------
-boolean canDiag::ReadCAN(BatteryDiag_t *myBMS, unsigned long _rxID) {
-  //Set CAN-Bus filter for specified rxID or clear filter
-  if (_rxID > 0) {
-    this->setCAN_Filter(_rxID);
-  } else {
-    this->clearCAN_Filter();
-  }
+void canDiag::updateLatest(byte field) {
+  latest[field].time = millis();
+  latest[field].updates++;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Get age and update count of a sniffed BMS value
+//! \param   field (SniffField_t)
+//! \return  ms since the last update, 0xFFFFFFFF if never received
+//--------------------------------------------------------------------------------
+unsigned long canDiag::getValueAge(byte field) {
+  if (latest[field].updates == 0) return 0xFFFFFFFF;
+  return millis() - latest[field].time;
+}
+
+uint16_t canDiag::getValueUpdates(byte field) {
+  return latest[field].updates;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Check if a sniffed BMS value was not updated for LATEST_STALE ms
+//! \param   field (SniffField_t)
+//! \return  value is stale or was never received (boolean)
+//--------------------------------------------------------------------------------
+boolean canDiag::isStale(byte field) {
+  return this->getValueAge(field) > LATEST_STALE;
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Read the wanted drive values from CAN traffic in one pass
+//! \param   bit per wanted field (DrvField_t)
+//! \return  bit per field obtained (byte)
+//--------------------------------------------------------------------------------
+byte canDiag::SniffDRV(DriveStats_t *myDRV, byte wanted) {
+  return this->Sniff(kDRV_DISPATCH, ENTRIES(kDRV_DISPATCH), myDRV, wanted);
+}
+
+//--------------------------------------------------------------------------------
+//! \brief   Decode broadcast messages of a dispatch table until every wanted 
+//! \brief   field was seen or the timeout expires
+//! \param   dispatch table in PROGMEM (CANdispatch_t*), count of entries, 
+//! \param   destination data structure, bit per wanted field
+//! \return  bit per field obtained (byte)
+//--------------------------------------------------------------------------------
+byte canDiag::Sniff(const CANdispatch_t *table, byte entries, void *dest, byte wanted) {
+  CANdispatch_t entry;
+  byte seen = 0;
+
+  if (wanted == 0 || fLent) return 0;       // bus monitor owns filters and frames
+  this->setCAN_Filters(table, entries, wanted);
   
-  //Reset timeout timer
+  //One timeout for the whole pass
   myCAN_Timeout->Reset();
   
-  boolean _fOK = false;
-
-  //event counter
-  byte SOC = 0;
-  byte rSOC = 0;
-  byte Pc = 0;
-  byte HVc = 0;
-  byte LVc = 0;
-  byte ODO = 0;
-  byte Tc = 0;  
-  
   do {    
-    if(!digitalRead(2)) { 
-      
-      //Read CAN traffic and evaluate ID
-      myCAN0->readMsgBuf(&rxID, &len, rxBuf);   
-      
-      if (rxID == 0x518) {
-        myBMS->SOC = (float) rxBuf[7] / 2;
-        SOC = 1;
-        _fOK = true;
-      }
-      if (rxID == 0x2D5) {
-        myBMS->realSOC = combine_bytes(rxBuf[4], rxBuf[5]) & 0x3ff;
-        rSOC = 1;
-        _fOK = true;
-      }
-      if (rxID == 0x508) {
-        int16_t value = 0;
-        value = combine_bytes(rxBuf[2], rxBuf[3]) & 0x3fff;
-        myBMS->Amps2 = (value - 0x2000) / 10.0;
-        CalcPower(myBMS);
-        Pc = 1;
-        _fOK = true;
-      }
-      if (rxID == 0x448) {
-        float HV;
-        HV = (float)combine_bytes(rxBuf[6], rxBuf[7]);
-        HV = HV / 10.0;
-        myBMS->HV = HV;
-        HVc = 1;
-        _fOK = true;
+    //Read CAN traffic and dispatch by ID, other IDs may pass the filters
+    if(myCAN0->readMsgBuf(&rxID, &len, rxBuf) == CAN_OK) { 
+      if (findDispatch(table, entries, rxID, &entry)) {
+        entry.decode(dest, rxBuf);
+        if (table == kBMS_DISPATCH) this->updateLatest(entry.field);
+        bitSet(seen, entry.field);
+        if ((seen & wanted) == wanted) break;
       }
-      if (rxID == 0x3D5) {
-        float LV;
-        LV = ((float)rxBuf[3]);
-        LV = LV / 10.0;
-        myBMS->LV = LV;
-        LVc = 1;
-        _fOK = true;
-      }
-      if (rxID == 0x412) {
-        myBMS->ODO = combine_bytes_3(rxBuf[2], rxBuf[3], rxBuf[4]);
-        ODO = 1;
-        _fOK = true;
-      }
-      if (rxID == 0x512) {
-        myBMS->hour = rxBuf[0];
-        myBMS->minutes = rxBuf[1];
-        Tc = 1;
-        _fOK = true;
-      }
-    }
-    byte done = SOC + rSOC + Pc + HVc + LVc + ODO + Tc;
-    if ((_fOK && _rxID > 0) || done == 7) {
-      return _fOK;
     }
   } while (!myCAN_Timeout->Expired(false));
-  
-  return false;
+  this->respID = 0;                           // filters are set again by the next request
+  return seen;
 }
 
 //--------------------------------------------------------------------------------
@@ -1381,7 +2267,7 @@ boolean canDiag::ReadCAN(BatteryDiag_t *myBMS, unsigned long _rxID) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadSOC(BatteryDiag_t *myBMS) {
-  return this->ReadCAN(myBMS, 0x518);
+  return this->SniffBMS(myBMS, bit(SNIFF_SOC)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1389,7 +2275,7 @@ boolean canDiag::ReadSOC(BatteryDiag_t *myBMS) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadSOCinternal(BatteryDiag_t *myBMS) {
-  return this->ReadCAN(myBMS, 0x2D5);
+  return this->SniffBMS(myBMS, bit(SNIFF_RSOC)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1406,12 +2292,7 @@ boolean canDiag::CalcPower(BatteryDiag_t *myBMS) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadPower(BatteryDiag_t *myBMS) {
-  if (ReadHV(myBMS) && ReadAmps(myBMS)) {
-    CalcPower(myBMS);
-    return true;
-  } else {
-    return false;
-  }
+  return this->SniffBMS(myBMS, bit(SNIFF_POWER)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1419,7 +2300,7 @@ boolean canDiag::ReadPower(BatteryDiag_t *myBMS) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadHV(BatteryDiag_t *myBMS) {
-  return this->ReadCAN(myBMS, 0x448);
+  return this->SniffBMS(myBMS, bit(SNIFF_HV)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1427,7 +2308,7 @@ boolean canDiag::ReadHV(BatteryDiag_t *myBMS) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadAmps(BatteryDiag_t *myBMS) {
-  return this->ReadCAN(myBMS, 0x508);
+  return this->SniffBMS(myBMS, bit(SNIFF_AMPS)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1435,7 +2316,7 @@ boolean canDiag::ReadAmps(BatteryDiag_t *myBMS) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadLV(BatteryDiag_t *myBMS) {
-  return this->ReadCAN(myBMS, 0x3D5);
+  return this->SniffBMS(myBMS, bit(SNIFF_LV)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1443,7 +2324,7 @@ boolean canDiag::ReadLV(BatteryDiag_t *myBMS) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadODO(BatteryDiag_t *myBMS) {
-  return this->ReadCAN(myBMS, 0x412);
+  return this->SniffBMS(myBMS, bit(SNIFF_ODO)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1451,92 +2332,21 @@ boolean canDiag::ReadODO(BatteryDiag_t *myBMS) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadTime(BatteryDiag_t *myBMS) {
-  return this->ReadCAN(myBMS, 0x512);
+  return this->SniffBMS(myBMS, bit(SNIFF_TIME)) != 0;
 }
 
 //--------------------------------------------------------------------------------
-//! \brief   Read and evaluate CAN messages related to drivetrain
+//! \brief   Read CAN messages related to drivetrain, only one given ID or all
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadCAN(DriveStats_t *myDRV, unsigned long _rxID) {
-  //Set CAN-Bus filter for specified rxID or clear filter
-  if (_rxID > 0) {
-    this->setCAN_Filter(_rxID);
-  } else {
-    //this->clearCAN_Filter();
-    this->setCAN_Filter_DRV();
+  if (_rxID == 0) {
+    return this->SniffDRV(myDRV, DRV_ALL) == DRV_ALL;
+  }
+  CANdispatch_t entry;
+  if (findDispatch(kDRV_DISPATCH, ENTRIES(kDRV_DISPATCH), _rxID, &entry)) {
+    return this->SniffDRV(myDRV, bit(entry.field)) != 0;
   }
-  
-  //Reset timeout timer
-  myCAN_Timeout->Reset();
-
-  boolean _fOK = false;
-
-  //event counter
-  byte Vc = 0;
-  byte Rc = 0;
-  byte Ec = 0;
-  byte Oc = 0;
-  byte ECO = 0;
-  byte HVs = 0;
-  
-  do {    
-    if(!digitalRead(2)) { 
-      
-      //Read CAN traffic and evaluate ID
-      myCAN0->readMsgBuf(&rxID, &len, rxBuf); 
-      //Serial.print(" CANrx: ");
-
-      if (rxID == 0x200) {
-        myDRV->velocity = (((uint16_t)rxBuf[2] << 8) | rxBuf[3]) / 18;
-        Vc = 1;
-        _fOK = true;
-      }
-
-      if (rxID == 0x318) {
-        myDRV->usablePower = rxBuf[5];
-        myDRV->range = rxBuf[7];
-        Rc = 1;
-        _fOK = true;
-      }
-
-      if (rxID == 0x3CE) {
-        myDRV->energyStart = combine_bytes(rxBuf[0], rxBuf[1]);
-        myDRV->energyReset = combine_bytes(rxBuf[2], rxBuf[3]);
-        Ec = 1;
-        _fOK = true;
-      }
-
-      if (rxID == 0x3D7) {
-        myDRV->HVactive = rxBuf[0];
-        HVs = 1;
-        _fOK = true;
-      }
-      
-      if (rxID == 0x3F2) {
-        myDRV->ECO_accel = rxBuf[0] >> 1;
-        myDRV->ECO_const = rxBuf[1] >> 1;
-        myDRV->ECO_coast = rxBuf[2] >> 1;
-        myDRV->ECO_total = rxBuf[3] >> 1;
-        ECO = 1;
-        _fOK = true;
-      }
-
-      if (rxID == 0x504) {
-        uint16_t value;
-        value = combine_bytes(rxBuf[1], rxBuf[2]);
-        if (value != 254) myDRV->odoStart = value; 
-        value = combine_bytes(rxBuf[4], rxBuf[5]);
-        if (value != 254) myDRV->odoReset = value;
-        Oc = 1;
-        _fOK = true;
-      }
-    }
-    byte done = Vc + Rc + Ec + Oc + ECO + HVs;
-    if ((_fOK && _rxID > 0) || done == 6) {
-      return _fOK;
-    }
-  } while (!myCAN_Timeout->Expired(false));
   return false;
 }
 
@@ -1545,7 +2355,7 @@ boolean canDiag::ReadCAN(DriveStats_t *myDRV, unsigned long _rxID) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadVelocity(DriveStats_t *myDRV) {
-  return this->ReadCAN(myDRV, 0x200);
+  return this->SniffDRV(myDRV, bit(DRV_VELOCITY)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1553,7 +2363,7 @@ boolean canDiag::ReadVelocity(DriveStats_t *myDRV) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadRange(DriveStats_t *myDRV) {
-  return this->ReadCAN(myDRV, 0x318);
+  return this->SniffDRV(myDRV, bit(DRV_RANGE)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1561,7 +2371,7 @@ boolean canDiag::ReadRange(DriveStats_t *myDRV) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadEnergyConsumption(DriveStats_t *myDRV) {
-  return this->ReadCAN(myDRV, 0x3CE);
+  return this->SniffDRV(myDRV, bit(DRV_ENERGY)) != 0;
 }
 
 
@@ -1570,7 +2380,7 @@ boolean canDiag::ReadEnergyConsumption(DriveStats_t *myDRV) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadECO(DriveStats_t *myDRV) {
-  return this->ReadCAN(myDRV, 0x3F2);
+  return this->SniffDRV(myDRV, bit(DRV_ECO)) != 0;
 }
 
 //--------------------------------------------------------------------------------
@@ -1578,5 +2388,5 @@ boolean canDiag::ReadECO(DriveStats_t *myDRV) {
 //! \return  report success (boolean)
 //--------------------------------------------------------------------------------
 boolean canDiag::ReadUserCounter(DriveStats_t *myDRV) {
-  return this->ReadCAN(myDRV, 0x504);
+  return this->SniffDRV(myDRV, bit(DRV_ODO)) != 0;
 }
@@ -36,6 +36,7 @@
 #include <mcp_can.h>
 #include <Timeout.h>
 #include <AvgNew.h>
+#include "_DID_dfs.h"
 #include "_BMS_dfs.h"
 #include "_NLG6_dfs.h"
 #include "_CS_dfs.h"
@@ -43,6 +44,98 @@
 
 extern uint16_t g_failure;
 
+#define FC_BS_DEFAULT 0x08       //!< default block size of flow control frames
+#define FC_STMIN_DEFAULT 0x14    //!< default separation time of consecutive frames in ms
+
+//! ECUs queried for diagnostic data, index for per ECU settings
+typedef enum {ECU_BMS = 0, ECU_NLG6, ECU_CLS, ECU_COUNT} ECU_t;
+
+//! ISO-TP flow control parameters requested from an ECU
+typedef struct {
+  byte BS;                       //!< block size, 0 := all frames without further flow control
+  byte STmin;                    //!< minimum separation time of consecutive frames in ms
+} FlowControl_t;
+
+//! States of the ISO-TP state machine for diagnostic requests
+typedef enum {ISOTP_IDLE = 0, ISOTP_WAIT_FIRST, ISOTP_WAIT_CF, ISOTP_DONE, ISOTP_NRC, ISOTP_TIMEOUT, ISOTP_SEQ_ERROR, ISOTP_OVERFLOW} IsoTpState_t;
+
+#define DIAG_QUEUE_TIMEOUT 2000  //!< timeout of queued requests in ms
+#define DIAG_RETRIES 2           //!< requests sent again after lost consecutive frames
+#define DIAG_DISCOVERY_WINDOW 300 //!< time to collect answers of ECU discovery in ms
+//! Battery values sniffed from broadcast messages, bit in the result of #SniffBMS
+typedef enum {SNIFF_SOC = 0, SNIFF_RSOC, SNIFF_AMPS, SNIFF_HV, SNIFF_POWER, SNIFF_LV, SNIFF_ODO, SNIFF_TIME, SNIFF_FIELDS} SniffField_t;
+#define SNIFF_ALL 0xFF           //!< all fields of SniffField_t
+
+//! Drive values sniffed from broadcast messages, bit in the result of #SniffDRV
+typedef enum {DRV_VELOCITY = 0, DRV_RANGE, DRV_ENERGY, DRV_HV_ACTIVE, DRV_ECO, DRV_ODO, DRV_FIELDS} DrvField_t;
+#define DRV_ALL ((1 << DRV_FIELDS) - 1) //!< all fields of DrvField_t
+
+//! Decoder of a broadcast message, stores the values in the destination data structure
+typedef void (*CANdecoder_t)(void *dest, const byte *buf);
+
+//! Entry of a broadcast dispatch table (PROGMEM), tables are sorted by CAN ID
+typedef struct {
+  uint16_t ID;                   //!< 11 bit CAN ID
+  byte field;                    //!< field bit set when the message is decoded
+  CANdecoder_t decode;           //!< decoder of the message
+} CANdispatch_t;
+
+//! Latest broadcast value, the value itself is kept in the destination data structure
+typedef struct {
+  unsigned long time;            //!< millis() of the last update
+  uint16_t updates;              //!< updates since startup
+} LatestValue_t;
+
+#define LATEST_STALE 3000        //!< ms without update after which a broadcast value is stale
+
+#define FILTER_MAX_IDS 12        //!< CAN IDs the filter allocator can take at once
+#define QUEUE_LENGTH_NLG6 96     //!< buffer for queued charger responses
+#define QUEUE_LENGTH_CLS 120     //!< buffer for queued cooling responses
+
+//! ISO-TP session of an ECU, sessions of different ECUs run in parallel
+typedef struct {
+  uint16_t rqID;                 //!< request CAN ID
+  uint16_t respID;               //!< response CAN ID
+  byte state;                    //!< state of the running request (IsoTpState_t)
+  byte BS;                       //!< flow control block size of the running request
+  byte STmin;                    //!< flow control separation time of the running request
+  byte NRC;                      //!< negative response code of a queued request
+  byte *buf;                     //!< reassembly buffer
+  uint16_t room;                 //!< size of reassembly buffer
+  uint16_t length;               //!< data length announced by the first frame
+  uint16_t rspLength;            //!< response length of single or first frame
+  int16_t items;                 //!< data bytes still to receive
+  int16_t pos;                   //!< write position in reassembly buffer
+  uint16_t lines;                //!< result: received lines á 7 bytes, 0 on failure
+  uint16_t rspLine;              //!< consecutive frames received
+  int16_t FC_count;              //!< consecutive frames since first frame
+  unsigned long tLast;           //!< time of last request or frame in ms
+  const byte* const* list;       //!< queued requests (PROGMEM)
+  byte count;                    //!< count of queued requests
+  byte next;                     //!< next queued request to send
+  byte *store;                   //!< responses of queued requests
+  uint16_t size;                 //!< size of store
+  uint16_t fill;                 //!< used bytes of store
+} IsoTpSession_t;
+
+#define DID_BATCH_MAX 3          //!< DIDs per multi-DID request (single frame request)
+#define DID_BATCH_SIZE 4         //!< maximum data bytes of a DID in a multi-DID request
+#define DID_SIZE_CACHE 16        //!< DIDs with known response size
+
+//! Response size of a DID, learned from single DID requests
+typedef struct {
+  uint16_t DID;
+  byte size;                     //!< data bytes without service ID and DID
+} DIDsize_t;
+
+//! Negative response (0x7F) of an ECU to the last diagnostic request
+typedef struct {
+  byte code;                     //!< negative response code (NRC), 0 if none received
+  byte service;                  //!< rejected service ID, e.g. 0x22
+  uint16_t DID;                  //!< data identifier of the rejected request
+  uint16_t ECU;                  //!< request CAN ID of the rejecting ECU
+} DiagNRC_t;
+
 class canDiag { 
  
 private:
@@ -60,26 +153,79 @@ private:
     byte len = 0;
     byte rxLength = 0;
     byte rxBuf[8];
-    byte rqFlowControl[8] = {0x30, 0x08, 0x14, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
-    byte rqFC_length = 8;   //!< Interval to send flow control messages (rqFC) 
     byte rqWakeUp[7] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
     //byte rqWakeUp[1] = {0x00};
 
     unsigned long rqID;
     unsigned long respID;
-    uint16_t SkipStart;
-    uint16_t SkipEnd;
-    boolean SkipEnable = false;
+    const DataWindow_t *windowList; //!< windows of foreground response kept in data
+    byte windowCount = 0;
+
+    //ISO-TP state machine, one session per ECU
+    IsoTpSession_t session[ECU_COUNT];
+    IsoTpSession_t *fgSession = NULL; //!< session of request started by beginRequest
+    boolean fgActive = false;      //!< request started by beginRequest running
+    boolean fQueued = false;       //!< queued requests set up, filters for all ECUs
+    boolean fLent = false;         //!< data buffer lent out, no requests
+    uint16_t rqLines = 0;          //!< result: received lines á 7 bytes, 0 on failure
+    void (*onComplete)(uint16_t lines) = 0;
+    void (*onIdle)() = 0;
+    void (*onFrame)(unsigned long id, byte len, byte *buf) = 0;
+
+    FlowControl_t FCprofile[ECU_COUNT]; //!< flow control parameters per ECU
+
+    DiagNRC_t lastNRC;             //!< NRC of the last request, code 0 if not rejected
+    uint16_t NRC_count = 0;        //!< negative responses received since startup
+    unsigned long NRC_savedTime = 0; //!< ms not spent waiting for the CAN timeout
+    uint16_t seqErrorCount = 0;    //!< responses with lost consecutive frames
+    uint16_t retryCount = 0;       //!< requests sent again
         
+    Average *streamAvg = NULL;     //!< values of foreground request decoded while received
+    uint16_t streamStart;          //!< position of first high byte in data
+    byte streamCount;              //!< values still to decode
+    byte streamHigh;               //!< high byte of a value split across frames
+
+    LatestValue_t latest[SNIFF_FIELDS]; //!< update time and count of the sniffed BMS values
+    BatteryDiag_t *bgBMS = NULL;   //!< destination of background sniffing, NULL := off
+    boolean bgFiltered = false;    //!< filters let the background IDs pass
+
+    DIDsize_t DIDsize[DID_SIZE_CACHE]; //!< known DID response sizes
+    byte DIDsizeCount = 0;
+    byte DIDbatchRejected = 0;     //!< bit per ECU: multi-DID requests rejected
+
+    byte getECU(unsigned long _rqID);
     uint16_t Request_Diagnostics(const byte* rqQuery);
-    uint16_t Get_RequestResponse();
-    boolean Read_FC_Response(int16_t items);
+    uint16_t Request_Message(byte* rqMsg);
+    IsoTpSession_t* getSession(unsigned long _rqID);
+    boolean isBusy(IsoTpSession_t *s);
+    void buildRequest(byte *rqMsg, const byte* rqQuery);
+    void sendRequest(IsoTpSession_t *s, byte* rqMsg);
+    void beginMessage(byte* rqMsg);
+    void sendFlowControl(IsoTpSession_t *s, byte flowStatus = 0x30);
+    void handleFrame(IsoTpSession_t *s);
+    void finishRequest(IsoTpSession_t *s, byte state);
+    void dropResponses(unsigned long ID);
+    void expireRequest(IsoTpSession_t *s);
+    void sendNext(IsoTpSession_t *s);
+    void storeQueued(IsoTpSession_t *s, byte state);
+    byte findQueued(IsoTpSession_t *s, const byte* rqQuery);
+    boolean getQueued(IsoTpSession_t *s, byte k, const byte* rqQuery);
     void PrintReadBuffer(uint16_t lines);
+    byte addBackgroundIDs(uint16_t *list, byte count);
+    void updateLatest(byte field);
+    boolean decodeBackground();
 
     void ReadBatteryTemperatures(BatteryDiag_t *myBMS, byte data_in[], uint16_t highOffset, uint16_t length);
-    void ReadCellCapacity(byte data_in[], uint16_t highOffset, uint16_t length);
-    void ReadCellVoltage(byte data_in[], uint16_t highOffset, uint16_t length);
+    void setWindows(const DataWindow_t *windows, byte count);
+    void windowByte(uint16_t pos, byte value);
+    void setStream(Average *avg, uint16_t highOffset, byte count);
+    void streamByte(uint16_t pos, byte value);
     void ReadDiagWord(uint16_t data_out[], byte data_in[], uint16_t highOffset, uint16_t length);
+    boolean ReadDIDs(const DiagDID_t *table, byte count, void *dest, byte variant, boolean debug_verbose);
+    void DecodeDID(const DiagDID_t *did, byte *dest);
+    byte ReadDIDbatch(const DiagDID_t *table, byte count, byte i, void *dest, byte variant, boolean debug_verbose);
+    void learnDIDsize();
+    byte getDIDsize(uint16_t DID);
   
 public:  
     canDiag();
@@ -91,6 +237,34 @@ public:
     void freeMem_CellCapacity();
 
     boolean WakeUp();
+    byte discoverECUs(uint16_t window);
+
+//--------------------------------------------------------------------------------
+//! \brief   Non-blocking diagnostic requests (ISO-TP state machine)
+//--------------------------------------------------------------------------------
+    void beginRequest(const byte* rqQuery);
+    boolean poll();
+    boolean isDone();
+    uint16_t getResponseLines();
+    void setCompleteCallback(void (*_onComplete)(uint16_t lines));
+    void setIdleCallback(void (*_onIdle)());
+    void setFrameCallback(void (*_onFrame)(unsigned long id, byte len, byte *buf));
+    boolean queueRequests(byte ecu);
+    void clearQueue();
+    byte *lendBuffer();
+    void returnBuffer();
+
+    void setFlowControl(byte ecu, byte BS, byte STmin);
+    FlowControl_t getFlowControl(byte ecu);
+    unsigned long probeFlowControl(byte ecu, byte BS, byte STmin);
+
+    boolean NRCreceived();
+    const DiagNRC_t* getLastNRC();
+    uint16_t getNRCcount();
+    unsigned long getNRCsavedTime();
+    uint16_t getSeqErrorCount();
+    uint16_t getRetryCount();
+    boolean DIDbatching(byte ecu);
 
     boolean ReadCAN(BatteryDiag_t *myBMS, unsigned long _rxID);
     boolean ReadCAN(DriveStats_t *myDRV, unsigned long _rxID);
@@ -102,9 +276,13 @@ public:
     void clearCAN_Filter();
     boolean ClearReadBuffer();
     void setCAN_Filter(unsigned long filter);
+    boolean setCAN_Filters(const uint16_t *IDs, byte count);
+    boolean setCAN_Filters(const CANdispatch_t *table, byte entries, byte fields);
+    byte Sniff(const CANdispatch_t *table, byte entries, void *dest, byte wanted);
     void setCAN_ID(unsigned long _respID);
     void setCAN_ID(unsigned long _rqID, unsigned long _respID);
     void setCAN_Filter_DRV();
+    void setCAN_Filter_Diag();
 
 //--------------------------------------------------------------------------------
 //! \brief   Get methods for BMS data
@@ -133,6 +311,8 @@ public:
 //--------------------------------------------------------------------------------
     boolean NLG6ChargerInstalled(ChargerDiag_t *myNLG6, boolean debug_verbose);
     boolean printNLG6ChargerSWrev(ChargerDiag_t *myNLG6, boolean debug_verbose);
+    byte getChargerSWrev(byte *rev, byte size);
+    void printChargerSWrev(const byte *rev, byte length);
     boolean getChargerTemperature(ChargerDiag_t *myNLG6, boolean debug_verbose);
     boolean getChargerSelCurrent(ChargerDiag_t *myNLG6, boolean debug_verbose);
     boolean getChargerVoltages(ChargerDiag_t *myNLG6, boolean debug_verbose);
@@ -146,6 +326,13 @@ public:
 //--------------------------------------------------------------------------------
 //! \brief   Read BMS values from CAN-Bus traffic
 //--------------------------------------------------------------------------------
+    byte SniffBMS(BatteryDiag_t *myBMS, byte wanted);
+    byte SniffDRV(DriveStats_t *myDRV, byte wanted);
+    void setBackground(BatteryDiag_t *myBMS);
+    void background();
+    unsigned long getValueAge(byte field);
+    uint16_t getValueUpdates(byte field);
+    boolean isStale(byte field);
     boolean ReadSOC(BatteryDiag_t *myBMS);
     boolean ReadSOCinternal(BatteryDiag_t *myBMS);
     boolean ReadPower(BatteryDiag_t *myBMS);
@@ -74,6 +74,7 @@ char myCMD[MAX_CMD_SIZE];
 boolean fECHO = true;  //flag for local echo of input characters
 
 byte HALcount = 0;
+boolean fPENDING = false;  //flag for a complete command line waiting for execution
 
 
 /**************************************************************************/
@@ -225,12 +226,44 @@ void cmd_handler()
 /**************************************************************************/
 void cmdPoll()
 {
+    if (fPENDING)
+    {
+        fPENDING = false;
+        cmd_parse((char *)msg);
+        msg_ptr = msg;
+    }
     while (Serial.available())
     {
         cmd_handler();
     }
 }
 
+/**************************************************************************/
+/*!
+    Collect input at the command prompt without executing it. May be called
+    while the sketch is busy (e.g. waiting for CAN data); a completed command
+    line is kept and executed by the next call of cmdPoll().
+*/
+/**************************************************************************/
+void cmdBuffer()
+{
+    while (!fPENDING && Serial.available())
+    {
+        char c = Serial.peek();
+        if (c == '\r')
+        {
+            Serial.read();
+            *msg_ptr = '\0';
+            Serial.print("\r\n");
+            fPENDING = true;
+        }
+        else
+        {
+            cmd_handler();
+        }
+    }
+}
+
 /**************************************************************************/
 /*!
     Initialize the command line interface. This sets the terminal speed and
@@ -67,6 +67,7 @@ void cmd_display();
 void set_cmd_display(const char *myCMD);
 void set_local_echo(boolean _fECHO);
 void cmdPoll();
+void cmdBuffer();
 void cmdAdd(const char *name, void (*func)(uint8_t argc, char **argv));
 uint32_t cmdStr2Num(char *str, uint8_t base);
 
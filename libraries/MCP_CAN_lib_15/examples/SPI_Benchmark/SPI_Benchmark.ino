@@ -0,0 +1,51 @@
+// SPI Benchmark Example
+// Measures how many MCP2515 register reads per second are possible at
+// different SPI clocks. Each checkError() call is one register read of
+// three bytes in its own SPI transaction. No CAN bus is needed.
+//
+
+#include <mcp_can.h>
+#include <SPI.h>
+
+#define READS 1000
+
+MCP_CAN CAN0(10);     // Set CS to pin 10
+
+const unsigned long clocks[] = {1000000, 2000000, 4000000, 10000000};
+
+void setup()
+{
+  Serial.begin(115200);
+
+  // Initialize MCP2515 running at 16MHz with a baudrate of 500kb/s and the masks and filters disabled.
+  if(CAN0.begin(MCP_ANY, CAN_500KBPS, MCP_16MHZ) == CAN_OK) Serial.println("MCP2515 Initialized Successfully!");
+  else Serial.println("Error Initializing MCP2515...");
+}
+
+void loop()
+{
+  unsigned long t;
+
+  for(byte i = 0; i < sizeof(clocks) / sizeof(clocks[0]); i++){
+    CAN0.setSPIClock(clocks[i]);    // the fastest rate up to this value is used
+    t = micros();
+    for(int n = 0; n < READS; n++){
+      CAN0.checkError();
+    }
+    t = micros() - t;
+
+    Serial.print("SPI clock ");
+    Serial.print(clocks[i] / 1000);
+    Serial.print(" kHz: ");
+    Serial.print((float)t / READS);
+    Serial.print(" us/read, ");
+    Serial.print(1000000UL * READS / t);
+    Serial.println(" reads/s");
+  }
+  Serial.println();
+  delay(5000);
+}
+
+/*********************************************************************************************************
+  END FILE
+*********************************************************************************************************/
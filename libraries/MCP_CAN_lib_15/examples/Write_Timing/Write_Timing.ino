@@ -0,0 +1,63 @@
+// CAN Write Timing Example
+// Measures the time spent in sendMsgBuf and readMsgBuf per frame. The MCP2515
+// runs in loopback mode, so no CAN bus is needed. Enable MCP_LEGACY_DELAY in
+// mcp_can_dfs.h to compare with the 250us delay after each register write.
+//
+
+#include <mcp_can.h>
+#include <SPI.h>
+
+#define FRAMES 100
+
+MCP_CAN CAN0(10);     // Set CS to pin 10
+
+void setup()
+{
+  Serial.begin(115200);
+
+  // Initialize MCP2515 running at 16MHz with a baudrate of 500kb/s and the masks and filters disabled.
+  if(CAN0.begin(MCP_ANY, CAN_500KBPS, MCP_16MHZ) == CAN_OK) Serial.println("MCP2515 Initialized Successfully!");
+  else Serial.println("Error Initializing MCP2515...");
+
+  CAN0.setMode(MCP_LOOPBACK);   // Frames are received by the MCP2515 itself
+#if MCP_LEGACY_DELAY
+  Serial.println("Legacy timing (250us after register writes)");
+#else
+  Serial.println("Register writes without delay");
+#endif
+}
+
+byte data[8] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07};
+
+void loop()
+{
+  unsigned long txTime = 0, rxTime = 0, t;
+  long unsigned int rxId;
+  unsigned char len = 0;
+  unsigned char rxBuf[8];
+  int received = 0;
+
+  for(int i = 0; i < FRAMES; i++){
+    t = micros();
+    CAN0.sendMsgBuf(0x100, 0, 8, data);
+    txTime += micros() - t;
+
+    t = micros();
+    if(CAN0.readMsgBuf(&rxId, &len, rxBuf) == CAN_OK) received++;
+    rxTime += micros() - t;
+  }
+
+  Serial.print("send: ");
+  Serial.print(txTime / FRAMES);
+  Serial.print(" us/frame, read: ");
+  Serial.print(rxTime / FRAMES);
+  Serial.print(" us/frame, received ");
+  Serial.print(received);
+  Serial.print("/");
+  Serial.println(FRAMES);
+  delay(2000);
+}
+
+/*********************************************************************************************************
+  END FILE
+*********************************************************************************************************/
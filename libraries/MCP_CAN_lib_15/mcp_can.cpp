@@ -26,6 +26,14 @@
 #define spi_readwrite SPI.transfer
 #define spi_read() spi_readwrite(0x00)
 
+#define MCP_BARRIER() __asm__ __volatile__ ("" ::: "memory")      /* keep ring accesses in order  */
+
+#if MCP_LEGACY_DELAY
+#define MCP2515_WRITE_DELAY() delayMicroseconds(250)
+#else
+#define MCP2515_WRITE_DELAY()                                           /* registers are written at once*/
+#endif
+
 /*********************************************************************************************************
 ** Function name:           mcp2515_reset
 ** Descriptions:            Performs a software reset
@@ -84,7 +92,7 @@ void MCP_CAN::mcp2515_setRegister(const INT8U address, const INT8U value)
     spi_readwrite(address);
     spi_readwrite(value);
     MCP2515_UNSELECT();
-    delayMicroseconds(250);
+    MCP2515_WRITE_DELAY();
 }
 
 /*********************************************************************************************************
@@ -103,7 +111,7 @@ void MCP_CAN::mcp2515_setRegisterS(const INT8U address, const INT8U values[], co
         spi_readwrite(values[i]);
     }
     MCP2515_UNSELECT();
-    delayMicroseconds(250);
+    MCP2515_WRITE_DELAY();
 }
 
 /*********************************************************************************************************
@@ -118,7 +126,7 @@ void MCP_CAN::mcp2515_modifyRegister(const INT8U address, const INT8U mask, cons
     spi_readwrite(mask);
     spi_readwrite(data);
     MCP2515_UNSELECT();
-    delayMicroseconds(250);
+    MCP2515_WRITE_DELAY();
 }
 
 /*********************************************************************************************************
@@ -135,6 +143,16 @@ INT8U MCP_CAN::mcp2515_readStatus(void)
 	return i;
 }
 
+/*********************************************************************************************************
+** Function name:           setSPIClock
+** Descriptions:            Public function, Sets the SPI clock in Hz used by all transfers to the MCP2515.
+**                          SPI.h takes the fastest rate up to this, max. 10MHz for the MCP2515.
+*********************************************************************************************************/
+void MCP_CAN::setSPIClock(INT32U clock)
+{
+    m_spiSettings = SPISettings(clock, MSBFIRST, SPI_MODE0);
+}
+
 /*********************************************************************************************************
 ** Function name:           setMode
 ** Descriptions:            Sets control mode
@@ -152,21 +170,25 @@ INT8U MCP_CAN::setMode(const INT8U opMode)
 
 /*********************************************************************************************************
 ** Function name:           mcp2515_setCANCTRL_Mode
-** Descriptions:            Set control mode
+** Descriptions:            Set control mode and wait until it is entered
 *********************************************************************************************************/
 INT8U MCP_CAN::mcp2515_setCANCTRL_Mode(const INT8U newmode)
 {
     INT8U i;
+    unsigned long startTime = millis();
 
     mcp2515_modifyRegister(MCP_CANCTRL, MODE_MASK, newmode);
 
-    i = mcp2515_readRegister(MCP_CANCTRL);
-    i &= MODE_MASK;
+    do                                                                  /* the new mode is entered after*/
+    {                                                                   /* a running transmission, wait */
+        i = mcp2515_readRegister(MCP_CANSTAT);                          /* for OPMOD in CANSTAT         */
+        i &= MODE_MASK;
 
-    if ( i == newmode ) 
-    {
-        return MCP2515_OK;
-    }
+        if ( i == newmode ) 
+        {
+            return MCP2515_OK;
+        }
+    } while (millis() - startTime < MODE_TIMEOUT);
 
     return MCP2515_FAIL;
 }
@@ -577,9 +599,20 @@ INT8U MCP_CAN::mcp2515_init(const INT8U canIDMode, const INT8U canSpeed, const I
 *********************************************************************************************************/
 void MCP_CAN::mcp2515_write_id( const INT8U mcp_addr, const INT8U ext, const INT32U id )
 {
-    uint16_t canid;
     INT8U tbufdata[4];
 
+    mcp2515_encode_id( ext, id, tbufdata );
+    mcp2515_setRegisterS( mcp_addr, tbufdata, 4 );
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_encode_id
+** Descriptions:            Convert CAN ID to SIDH, SIDL, EID8, EID0 of a transmit buffer
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_encode_id( const INT8U ext, const INT32U id, INT8U tbufdata[] )
+{
+    uint16_t canid;
+
     canid = (uint16_t)(id & 0x0FFFF);
 
     if ( ext == 1) 
@@ -599,8 +632,6 @@ void MCP_CAN::mcp2515_write_id( const INT8U mcp_addr, const INT8U ext, const INT
         tbufdata[MCP_EID0] = 0;
         tbufdata[MCP_EID8] = 0;
     }
-    
-    mcp2515_setRegisterS( mcp_addr, tbufdata, 4 );
 }
 
 /*********************************************************************************************************
@@ -609,9 +640,20 @@ void MCP_CAN::mcp2515_write_id( const INT8U mcp_addr, const INT8U ext, const INT
 *********************************************************************************************************/
 void MCP_CAN::mcp2515_write_mf( const INT8U mcp_addr, const INT8U ext, const INT32U id )
 {
-    uint16_t canid;
     INT8U tbufdata[4];
 
+    mcp2515_encode_mf(ext, id, tbufdata);
+    mcp2515_setRegisterS( mcp_addr, tbufdata, 4 );
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_encode_mf
+** Descriptions:            Convert Mask or Filter to the 4 register values SIDH, SIDL, EID8, EID0
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_encode_mf( const INT8U ext, const INT32U id, INT8U tbufdata[] )
+{
+    uint16_t canid;
+
     canid = (uint16_t)(id & 0x0FFFF);
 
     if ( ext == 1) 
@@ -632,8 +674,6 @@ void MCP_CAN::mcp2515_write_mf( const INT8U mcp_addr, const INT8U ext, const INT
         tbufdata[MCP_SIDL] = (INT8U) ((canid & 0x07) << 5);
         tbufdata[MCP_SIDH] = (INT8U) (canid >> 3 );
     }
-    
-    mcp2515_setRegisterS( mcp_addr, tbufdata, 4 );
 }
 
 /*********************************************************************************************************
@@ -644,11 +684,17 @@ void MCP_CAN::mcp2515_read_id( const INT8U mcp_addr, INT8U* ext, INT32U* id )
 {
     INT8U tbufdata[4];
 
-    *ext = 0;
-    *id = 0;
-
     mcp2515_readRegisterS( mcp_addr, tbufdata, 4 );
+    mcp2515_decode_id( tbufdata, ext, id );
+}
 
+/*********************************************************************************************************
+** Function name:           mcp2515_decode_id
+** Descriptions:            Convert SIDH, SIDL, EID8, EID0 of a receive buffer to CAN ID
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_decode_id( const INT8U tbufdata[], INT8U* ext, INT32U* id )
+{
+    *ext = 0;
     *id = (tbufdata[MCP_SIDH]<<3) + (tbufdata[MCP_SIDL]>>5);
 
     if ( (tbufdata[MCP_SIDL] & MCP_TXB_EXIDE_M) ==  MCP_TXB_EXIDE_M ) 
@@ -705,6 +751,46 @@ void MCP_CAN::mcp2515_read_canMsg( const INT8U buffer_sidh_addr)        /* read
     mcp2515_readRegisterS( mcp_addr+5, &(m_nDta[0]), m_nDlc );
 }
 
+/*********************************************************************************************************
+** Function name:           mcp2515_read_rxbuf
+** Descriptions:            Read message with READ RX BUFFER in one SPI transaction,
+**                          RXnIF is cleared by the MCP2515 when CS is released
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_read_rxbuf( const INT8U instr, CAN_FRAME *frame ) /* MCP_READ_RX0 or MCP_READ_RX1 */
+{
+    INT8U tbufdata[5];
+    INT8U i;
+
+    MCP2515_SELECT();
+    spi_readwrite(instr);                                               /* starts at RXBnSIDH           */
+    for (i=0; i<5; i++)
+    {
+        tbufdata[i] = spi_read();
+    }
+    frame->len = tbufdata[MCP_DLC] & MCP_DLC_MASK;
+    if (frame->len > MAX_CHAR_IN_MESSAGE)
+    {
+        frame->len = MAX_CHAR_IN_MESSAGE;
+    }
+    for (i=0; i<frame->len; i++)                                        /* stop after the used bytes    */
+    {
+        frame->buf[i] = spi_read();
+    }
+    MCP2515_UNSELECT();
+
+    frame->time = millis();
+    m_stats.rxFrames[(instr == MCP_READ_RX1) ? 1 : 0]++;
+    mcp2515_decode_id( tbufdata, &frame->ext, &frame->id );
+    if (frame->ext)
+    {
+        m_nRtr = (tbufdata[MCP_DLC] & MCP_RXB_RTR_M) ? 1 : 0;
+    }
+    else
+    {
+        m_nRtr = (tbufdata[MCP_SIDL] & MCP_RXB_SRR_M) ? 1 : 0;
+    }
+}
+
 /*********************************************************************************************************
 ** Function name:           mcp2515_getNextFreeTXBuf
 ** Descriptions:            Send message
@@ -730,6 +816,67 @@ INT8U MCP_CAN::mcp2515_getNextFreeTXBuf(INT8U *txbuf_n)                 /* get N
     return res;
 }
 
+/*********************************************************************************************************
+** Function name:           mcp2515_getTxBuf
+** Descriptions:            Get a free transmit buffer (0..2) from the cached bitmap, the TXREQ bits
+**                          are only read from the MCP2515 when all buffers seem to be in use
+*********************************************************************************************************/
+INT8U MCP_CAN::mcp2515_getTxBuf(INT8U *txbuf_n)
+{
+    INT8U i, stat;
+    INT8U txreq[MCP_N_TXBUFFERS] = { MCP_STAT_TX0REQ, MCP_STAT_TX1REQ, MCP_STAT_TX2REQ };
+
+    if ( m_nTxFree == 0 )
+    {
+        stat = mcp2515_readStatus();
+        for (i=0; i<MCP_N_TXBUFFERS; i++) {
+            if ( (stat & txreq[i]) == 0 ) {
+                m_nTxFree |= (1 << i);
+            }
+        }
+    }
+    for (i=0; i<MCP_N_TXBUFFERS; i++) {
+        if ( m_nTxFree & (1 << i) ) {
+            m_nTxFree &= ~(1 << i);
+            *txbuf_n = i;
+            return MCP2515_OK;
+        }
+    }
+    return MCP_ALLTXBUSY;
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_load_txbuf
+** Descriptions:            Write ID, DLC and data with LOAD TX BUFFER in one SPI transaction and
+**                          request to send
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_load_txbuf(const INT8U txbuf_n)
+{
+    INT8U i;
+    INT8U tbufdata[4];
+    INT8U loadcmd[MCP_N_TXBUFFERS] = { MCP_LOAD_TX0, MCP_LOAD_TX1, MCP_LOAD_TX2 };
+    INT8U rtscmd[MCP_N_TXBUFFERS] = { MCP_RTS_TX0, MCP_RTS_TX1, MCP_RTS_TX2 };
+
+    mcp2515_encode_id( m_nExtFlg, m_nID, tbufdata );
+
+    MCP2515_SELECT();
+    spi_readwrite(loadcmd[txbuf_n]);                                    /* starts at TXBnSIDH           */
+    for (i=0; i<4; i++)
+    {
+        spi_readwrite(tbufdata[i]);
+    }
+    spi_readwrite(m_nDlc);
+    for (i=0; i<m_nDlc; i++)
+    {
+        spi_readwrite(m_nDta[i]);
+    }
+    MCP2515_UNSELECT();
+
+    MCP2515_SELECT();
+    spi_readwrite(rtscmd[txbuf_n]);                                     /* sets TXREQ                   */
+    MCP2515_UNSELECT();
+}
+
 /*********************************************************************************************************
 ** Function name:           MCP_CAN
 ** Descriptions:            Public function to declare CAN class and the /CS pin.
@@ -737,8 +884,10 @@ INT8U MCP_CAN::mcp2515_getNextFreeTXBuf(INT8U *txbuf_n)                 /* get N
 MCP_CAN::MCP_CAN(INT8U _CS)
 {
     MCPCS = _CS;
+    m_bRxRing = 0;
+    m_spiSettings = SPISettings(MCP_SPI_CLOCK, MSBFIRST, SPI_MODE0);
     pinMode(MCPCS, OUTPUT);
-    MCP2515_UNSELECT();
+    digitalWrite(MCPCS, HIGH);                                          /* SPI is not started yet       */
 }
 
 /*********************************************************************************************************
@@ -753,13 +902,13 @@ INT8U MCP_CAN::begin(INT8U idmodeset, INT8U speedset, INT8U clockset)
     Serial.println("SPI init\r\n");
 #endif
 
-    SPI.begin();
-    //SPI.setClockDivider(SPI_CLOCK_DIV8); 
-    //SPI.setBitOrder(MSBFIRST); 
-    //SPI.setDataMode(SPI_MODE0); 
+    SPI.begin();                                                        /* clock: see setSPIClock       */
 
 
     res = mcp2515_init(idmodeset, speedset, clockset);
+    m_nTxFree = (1 << MCP_N_TXBUFFERS) - 1;                             /* all buffers are free         */
+    m_nEflg = 0;
+    clearStats();
     if (res == MCP2515_OK) {
 #if DEBUG_MODE
     Serial.println("MCP begin OK\r\n");
@@ -877,6 +1026,55 @@ INT8U MCP_CAN::init_Filt(INT8U num, INT8U ext, INT32U ulData)
     return res;
 }
 
+/*********************************************************************************************************
+** Function name:           setFilterSet
+** Descriptions:            Public function to set both masks and all six filters, configuration
+**                          mode is entered and left only once.
+*********************************************************************************************************/
+INT8U MCP_CAN::setFilterSet(const INT32U masks[2], const INT32U filters[6], INT8U ext)
+{
+    INT8U res = MCP2515_OK;
+    INT8U tbufdata[12];
+    INT8U i;
+#if DEBUG_MODE
+    Serial.print("Starting to Set Filter Set!!!\r\n");
+#endif
+    res = mcp2515_setCANCTRL_Mode(MODE_CONFIG);
+    if(res > 0)
+    {
+#if DEBUG_MODE
+      Serial.print("Enter Configuration Mode Failure...\r\n"); 
+#endif
+      return res;
+    }
+
+    for (i = 0; i < 2; i++)                                             /* RXM0, RXM1 are successive    */
+        mcp2515_encode_mf(ext, masks[i], &tbufdata[4 * i]);
+    mcp2515_setRegisterS(MCP_RXM0SIDH, tbufdata, 8);
+
+    for (i = 0; i < 3; i++)                                             /* RXF0 ... RXF2                */
+        mcp2515_encode_mf(ext, filters[i], &tbufdata[4 * i]);
+    mcp2515_setRegisterS(MCP_RXF0SIDH, tbufdata, 12);
+
+    for (i = 0; i < 3; i++)                                             /* RXF3 ... RXF5                */
+        mcp2515_encode_mf(ext, filters[i + 3], &tbufdata[4 * i]);
+    mcp2515_setRegisterS(MCP_RXF3SIDH, tbufdata, 12);
+
+    res = mcp2515_setCANCTRL_Mode(mcpMode);
+    if(res > 0)
+    {
+#if DEBUG_MODE
+      Serial.print("Entering Previous Mode Failure...\r\nSetting Filter Set Failure...\r\n"); 
+#endif
+      return res;
+    }
+#if DEBUG_MODE
+    Serial.print("Setting Filter Set Successfull!!!\r\n");
+#endif
+
+    return res;
+}
+
 /*********************************************************************************************************
 ** Function name:           setMsg
 ** Descriptions:            Set can message, such as dlc, id, dta[] and so on
@@ -886,8 +1084,8 @@ INT8U MCP_CAN::setMsg(INT32U id, INT8U ext, INT8U len, INT8U *pData)
     int i = 0;
     m_nExtFlg = ext;
     m_nID     = id;
-    m_nDlc    = len;
-    for(i = 0; i<MAX_CHAR_IN_MESSAGE; i++)
+    m_nDlc    = (len > MAX_CHAR_IN_MESSAGE) ? MAX_CHAR_IN_MESSAGE : len;
+    for(i = 0; i<m_nDlc; i++)
     m_nDta[i] = *(pData+i);
     return MCP2515_OK;
 }
@@ -915,35 +1113,52 @@ INT8U MCP_CAN::clearMsg()
 *********************************************************************************************************/
 INT8U MCP_CAN::sendMsg()
 {
-    INT8U res, res1, txbuf_n;
+    INT8U res, txbuf_n;
+    INT8U txreq[MCP_N_TXBUFFERS] = { MCP_STAT_TX0REQ, MCP_STAT_TX1REQ, MCP_STAT_TX2REQ };
     uint16_t uiTimeOut = 0;
 
-    do {
-        res = mcp2515_getNextFreeTXBuf(&txbuf_n);                       /* info = addr.                 */
-        uiTimeOut++;
-    } while (res == MCP_ALLTXBUSY && (uiTimeOut < TIMEOUTVALUE));
-
-    if(uiTimeOut == TIMEOUTVALUE) 
-    {   
-        return CAN_GETTXBFTIMEOUT;                                      /* get tx buff time out         */
+    res = queueMsg(&txbuf_n);
+    if (res != CAN_OK)
+    {
+        return res;
     }
-    uiTimeOut = 0;
-    mcp2515_write_canMsg( txbuf_n);
-    mcp2515_modifyRegister( txbuf_n-1 , MCP_TXB_TXREQ_M, MCP_TXB_TXREQ_M );
     do
     {
         uiTimeOut++;        
-        res1 = mcp2515_readRegister(txbuf_n-1);                         /* read send buff ctrl reg 	*/
-        res1 = res1 & 0x08;                               		
-    }while(res1 && (uiTimeOut < TIMEOUTVALUE));   
+        res = mcp2515_readStatus() & txreq[txbuf_n];                    /* TXREQ of the used buffer     */
+    }while(res && (uiTimeOut < TIMEOUTVALUE));   
     if(uiTimeOut == TIMEOUTVALUE)                                       /* send msg timeout             */	
     {
         return CAN_SENDMSGTIMEOUT;
     }
+    m_nTxFree |= (1 << txbuf_n);
     return CAN_OK;
 
 }
 
+/*********************************************************************************************************
+** Function name:           queueMsg
+** Descriptions:            Load message to a free transmit buffer and request to send,
+**                          returns without waiting for the transmission
+*********************************************************************************************************/
+INT8U MCP_CAN::queueMsg(INT8U *txbuf_n)
+{
+    INT8U res;
+    uint16_t uiTimeOut = 0;
+
+    do {
+        res = mcp2515_getTxBuf(txbuf_n);
+        uiTimeOut++;
+    } while (res == MCP_ALLTXBUSY && (uiTimeOut < TIMEOUTVALUE));
+
+    if(uiTimeOut == TIMEOUTVALUE) 
+    {   
+        return CAN_GETTXBFTIMEOUT;                                      /* get tx buff time out         */
+    }
+    mcp2515_load_txbuf(*txbuf_n);
+    return CAN_OK;
+}
+
 /*********************************************************************************************************
 ** Function name:           sendMsgBuf
 ** Descriptions:            Send message to transmitt buffer
@@ -951,14 +1166,28 @@ INT8U MCP_CAN::sendMsg()
 INT8U MCP_CAN::sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf)
 {
     setMsg(id, ext, len, buf);
-    sendMsg();
+    return sendMsg();
+}
+
+/*********************************************************************************************************
+** Function name:           sendMsgBufAsync
+** Descriptions:            Public function, Loads message to a transmit buffer and returns right after
+**                          the request to send. Frames pending in several buffers at the same time
+**                          are sent by buffer priority (TXB2 first), not in the order of the calls.
+*********************************************************************************************************/
+INT8U MCP_CAN::sendMsgBufAsync(INT32U id, INT8U ext, INT8U len, INT8U *buf)
+{
+    INT8U txbuf_n;
+
+    setMsg(id, ext, len, buf);
+    return queueMsg(&txbuf_n);
 }
 
 /*********************************************************************************************************
 ** Function name:           readMsg
 ** Descriptions:            Read message
 *********************************************************************************************************/
-INT8U MCP_CAN::readMsg()
+INT8U MCP_CAN::readMsg(CAN_FRAME *frame)
 {
     INT8U stat, res;
 
@@ -966,14 +1195,12 @@ INT8U MCP_CAN::readMsg()
 
     if ( stat & MCP_STAT_RX0IF )                                        /* Msg in Buffer 0              */
     {
-        mcp2515_read_canMsg( MCP_RXBUF_0);
-        mcp2515_modifyRegister(MCP_CANINTF, MCP_RX0IF, 0);
+        mcp2515_read_rxbuf( MCP_READ_RX0, frame );
         res = CAN_OK;
     }
     else if ( stat & MCP_STAT_RX1IF )                                   /* Msg in Buffer 1              */
     {
-        mcp2515_read_canMsg( MCP_RXBUF_1);
-        mcp2515_modifyRegister(MCP_CANINTF, MCP_RX1IF, 0);
+        mcp2515_read_rxbuf( MCP_READ_RX1, frame );
         res = CAN_OK;
     }
     else 
@@ -989,15 +1216,264 @@ INT8U MCP_CAN::readMsg()
 *********************************************************************************************************/
 INT8U MCP_CAN::readMsgBuf(INT32U *id, INT8U *len, INT8U buf[])
 {
-    readMsg();
-    *id  = m_nID;
-    *len = m_nDlc;
-    for(int i = 0; i<m_nDlc; i++)
+    INT8U res;
+    CAN_FRAME frame;
+
+    if (m_bRxRing)
+    {
+        res = pop(frame);
+    }
+    else
+    {
+        res = readMsg(&frame);
+    }
+    if (res != CAN_OK)
+    {
+        *len = 0;
+        return res;
+    }
+    *id  = frame.id;
+    *len = frame.len;
+    for(int i = 0; i<frame.len; i++)
+    {
+      buf[i] = frame.buf[i];
+    }
+    return res;
+}
+
+/*********************************************************************************************************
+** Function name:           readMsgBufs
+** Descriptions:            Public function, Reads all waiting messages from both receive buffers,
+**                          one status read serves both buffers. Returns the number of frames read.
+*********************************************************************************************************/
+INT8U MCP_CAN::readMsgBufs(CAN_FRAME frames[], INT8U max)
+{
+    INT8U stat, n = 0;
+
+    if (m_bRxRing)
+    {
+        while (n < max && pop(frames[n]) == CAN_OK)
+        {
+            n++;
+        }
+        return n;
+    }
+    while (n < max)
+    {
+        stat = mcp2515_readStatus() & MCP_STAT_RXIF_MASK;
+        if (!stat)
+        {
+            break;
+        }
+        if (stat & MCP_STAT_RX0IF)                                      /* RX0 is the older one         */
+        {
+            mcp2515_read_rxbuf( MCP_READ_RX0, &frames[n++] );
+        }
+        if ((stat & MCP_STAT_RX1IF) && n < max)
+        {
+            mcp2515_read_rxbuf( MCP_READ_RX1, &frames[n++] );
+        }
+    }
+    return n;
+}
+
+/*********************************************************************************************************
+** Function name:           enableRxInterrupt
+** Descriptions:            Public function, Receive by interrupt: the INT pin moves the frames from the
+**                          MCP2515 to a ring of CAN_RX_RING frames, read them with pop or readMsgBuf
+*********************************************************************************************************/
+static MCP_CAN *rxInstance = NULL;
+
+static void mcp2515_isr(void)
+{
+    rxInstance->handleInterrupt();
+}
+
+void MCP_CAN::enableRxInterrupt(INT8U intPin)
+{
+    rxInstance = this;
+    m_nRxHead = 0;
+    m_nRxTail = 0;
+    m_bRxRing = 1;
+    mcp2515_modifyRegister(MCP_CANINTE, MCP_ERRIF, MCP_ERRIF);          /* EFLG changes raise INT too   */
+    pinMode(intPin, INPUT);
+    SPI.usingInterrupt(digitalPinToInterrupt(intPin));                  /* no ISR during SPI transfers  */
+    noInterrupts();                                                     /* ISR is the only producer     */
+    attachInterrupt(digitalPinToInterrupt(intPin), mcp2515_isr, FALLING);
+    handleInterrupt();                                                  /* INT may already be low       */
+    interrupts();                                                       /* edges meanwhile run the ISR  */
+}
+
+/*********************************************************************************************************
+** Function name:           handleInterrupt
+** Descriptions:            Public function, Move all received frames to the ring. Called by the ISR,
+**                          frames that find the ring full are dropped and counted.
+*********************************************************************************************************/
+void MCP_CAN::handleInterrupt(void)
+{
+    INT8U intf, head;
+    CAN_FRAME dropped;
+    CAN_FRAME *frame;
+
+    while ( ((intf = mcp2515_readRegister(MCP_CANINTF)) & (MCP_RX0IF | MCP_RX1IF | MCP_ERRIF)) != 0 )
+    {
+        if (intf & MCP_ERRIF)
+        {
+            mcp2515_modifyRegister(MCP_CANINTF, MCP_ERRIF, 0);
+            mcp2515_sampleErrors();
+        }
+        if (!(intf & (MCP_RX0IF | MCP_RX1IF)))
+        {
+            continue;
+        }
+        head = m_nRxHead;
+        if ((INT8U)(head - m_nRxTail) < CAN_RX_RING)
+        {
+            frame = &m_rxRing[head & (CAN_RX_RING - 1)];
+        }
+        else
+        {
+            frame = &dropped;                                           /* read anyway to release INT   */
+            m_stats.ringOverflow++;
+        }
+        mcp2515_read_rxbuf( (intf & MCP_RX0IF) ? MCP_READ_RX0 : MCP_READ_RX1, frame );
+        if (frame != &dropped)
+        {
+            m_nRxHead = head + 1;
+        }
+    }
+}
+
+/*********************************************************************************************************
+** Function name:           pop
+** Descriptions:            Public function, Take the oldest frame from the receive ring, does not wait
+*********************************************************************************************************/
+INT8U MCP_CAN::pop(CAN_FRAME &frame)
+{
+    INT8U tail = m_nRxTail;
+
+    if (tail == m_nRxHead)
+    {
+        return CAN_NOMSG;
+    }
+    MCP_BARRIER();                                                      /* read the slot after the head */
+    frame = m_rxRing[tail & (CAN_RX_RING - 1)];
+    MCP_BARRIER();
+    m_nRxTail = tail + 1;                                               /* only now the ISR may reuse it*/
+    return CAN_OK;
+}
+
+/*********************************************************************************************************
+** Function name:           getRxOverflow
+** Descriptions:            Public function, Number of frames dropped because the receive ring was full
+*********************************************************************************************************/
+INT16U MCP_CAN::getRxOverflow(void)
+{
+    INT16U n;
+
+    noInterrupts();
+    n = m_stats.ringOverflow;
+    interrupts();
+    return n;
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_sampleErrors
+** Descriptions:            Read EFLG, TEC and REC and count them. The overflow flags are cleared, so each
+**                          overflow is counted once. Called by the ISR, or without it by getStats.
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_sampleErrors(void)
+{
+    INT8U eflg, cnt[2];
+
+    eflg = mcp2515_readRegister(MCP_EFLG);
+    mcp2515_readRegisterS(MCP_TEC, cnt, 2);                             /* TEC and REC                  */
+    mcp2515_countErrors(eflg, cnt);
+    if (eflg & (MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR))
+    {
+        mcp2515_modifyRegister(MCP_EFLG, MCP_EFLG_RX0OVR | MCP_EFLG_RX1OVR, 0);
+    }
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_countErrors
+** Descriptions:            Count receive overflows, changes to error passive and bus off, keep TEC and
+**                          REC. No SPI access, the caller protects m_stats from the ISR.
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_countErrors(INT8U eflg, const INT8U cnt[2])
+{
+    if (eflg & MCP_EFLG_RX0OVR)
+    {
+        m_stats.rxOverflow[0]++;
+    }
+    if (eflg & MCP_EFLG_RX1OVR)
+    {
+        m_stats.rxOverflow[1]++;
+    }
+    if ((eflg & (MCP_EFLG_TXEP | MCP_EFLG_RXEP)) && !(m_nEflg & (MCP_EFLG_TXEP | MCP_EFLG_RXEP)))
+    {
+        m_stats.errorPassive++;
+    }
+    if ((eflg & MCP_EFLG_TXBO) && !(m_nEflg & MCP_EFLG_TXBO))
+    {
+        m_stats.busOff++;
+    }
+    m_nEflg = eflg;
+    mcp2515_countLevels(cnt);
+}
+
+/*********************************************************************************************************
+** Function name:           mcp2515_countLevels
+** Descriptions:            Keep a sample of TEC and REC and their highest values
+*********************************************************************************************************/
+void MCP_CAN::mcp2515_countLevels(const INT8U cnt[2])
+{
+    m_stats.tec = cnt[0];
+    m_stats.rec = cnt[1];
+    if (cnt[0] > m_stats.tecMax)
     {
-      buf[i] = m_nDta[i];
+        m_stats.tecMax = cnt[0];
+    }
+    if (cnt[1] > m_stats.recMax)
+    {
+        m_stats.recMax = cnt[1];
     }
 }
 
+/*********************************************************************************************************
+** Function name:           getStats
+** Descriptions:            Public function, Sample the error flags and counters now and copy the
+**                          statistics. Without the receive ISR all EFLG events are only seen here.
+**                          With it the ISR owns EFLG, only TEC and REC are sampled here.
+*********************************************************************************************************/
+void MCP_CAN::getStats(CAN_STATS &stats)
+{
+    INT8U cnt[2];
+
+    if (!m_bRxRing)
+    {
+        mcp2515_sampleErrors();
+        stats = m_stats;
+        return;
+    }
+    mcp2515_readRegisterS(MCP_TEC, cnt, 2);                             /* SPI outside critical section */
+    noInterrupts();                                                     /* EFLG changes raise ERRIF,    */
+    mcp2515_countLevels(cnt);                                           /* the ISR counts them          */
+    stats = m_stats;
+    interrupts();
+}
+
+/*********************************************************************************************************
+** Function name:           clearStats
+** Descriptions:            Public function, Reset the statistics
+*********************************************************************************************************/
+void MCP_CAN::clearStats(void)
+{
+    noInterrupts();
+    memset(&m_stats, 0, sizeof(m_stats));
+    interrupts();
+}
+
 /*********************************************************************************************************
 ** Function name:           checkReceive
 ** Descriptions:            Public function, Checks for received data.  (Used if not using the interrupt output)
@@ -1005,6 +1481,10 @@ INT8U MCP_CAN::readMsgBuf(INT32U *id, INT8U *len, INT8U buf[])
 INT8U MCP_CAN::checkReceive(void)
 {
     INT8U res;
+    if (m_bRxRing)
+    {
+        return (m_nRxTail != m_nRxHead) ? CAN_MSGAVAIL : CAN_NOMSG;
+    }
     res = mcp2515_readStatus();                                         /* RXnIF in Bit 1 and 0         */
     if ( res & MCP_STAT_RXIF_MASK ) 
     {
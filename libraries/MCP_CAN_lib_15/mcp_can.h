@@ -27,6 +27,26 @@
 #include "mcp_can_dfs.h"
 #define MAX_CHAR_IN_MESSAGE 8
 
+typedef struct {                                                        // received CAN frame
+    INT32U  id;
+    INT8U   ext;
+    INT8U   len;
+    INT8U   buf[MAX_CHAR_IN_MESSAGE];
+    INT32U  time;                                                       // millis() when read
+} CAN_FRAME;
+
+typedef struct {                                                        // receive and error statistics
+    INT32U  rxFrames[2];                                                // frames read from RXB0 / RXB1
+    INT16U  rxOverflow[2];                                              // EFLG RX0OVR / RX1OVR seen
+    INT16U  ringOverflow;                                               // frames dropped, ring was full
+    INT16U  errorPassive;                                               // changes to error passive
+    INT16U  busOff;                                                     // changes to bus off
+    INT8U   tec;                                                        // last sample of TEC
+    INT8U   rec;                                                        // last sample of REC
+    INT8U   tecMax;                                                     // highest TEC seen
+    INT8U   recMax;                                                     // highest REC seen
+} CAN_STATS;
+
 class MCP_CAN
 {
     private:
@@ -41,6 +61,15 @@ class MCP_CAN
     INT8U   m_nfilhit;
     INT8U   MCPCS;
     INT8U   mcpMode;
+    SPISettings m_spiSettings;                                          // SPI clock and mode
+    INT8U   m_nTxFree;                                                  // bit per free transmit buffer
+
+    CAN_FRAME m_rxRing[CAN_RX_RING];                                    // frames moved by the ISR
+    volatile INT8U  m_nRxHead;                                          // written by the ISR only
+    volatile INT8U  m_nRxTail;                                          // written by pop only
+    INT8U   m_bRxRing;                                                  // receive by interrupt
+    CAN_STATS m_stats;                                                  // updated by driver and ISR
+    INT8U   m_nEflg;                                                    // last sample of EFLG
     
 
 /*
@@ -71,6 +100,9 @@ class MCP_CAN
                                 const INT8U data);
 
     INT8U mcp2515_readStatus(void);                                     // Read MCP2515 Status
+    void mcp2515_sampleErrors(void);                                    // Count EFLG events, TEC, REC
+    void mcp2515_countErrors(INT8U eflg, const INT8U cnt[2]);           // Count sampled EFLG, TEC, REC
+    void mcp2515_countLevels(const INT8U cnt[2]);                       // Keep sampled TEC, REC
     INT8U mcp2515_setCANCTRL_Mode(const INT8U newmode);                 // Set mode
     INT8U mcp2515_configRate(const INT8U canSpeed,                      // Set baudrate
                              const INT8U canClock);
@@ -82,18 +114,34 @@ class MCP_CAN
     void mcp2515_write_mf( const INT8U mcp_addr,                        // Write CAN Mask or Filter
                                const INT8U ext,
                                const INT32U id );
+
+    void mcp2515_encode_mf( const INT8U ext,                            // Convert CAN Mask or Filter
+                               const INT32U id,
+                               INT8U tbufdata[] );
 			       
     void mcp2515_write_id( const INT8U mcp_addr,                        // Write CAN ID
                                const INT8U ext,
                                const INT32U id );
 
+    void mcp2515_encode_id( const INT8U ext,                            // Convert CAN ID
+                               const INT32U id,
+                               INT8U tbufdata[] );
+
     void mcp2515_read_id( const INT8U mcp_addr,                         // Read CAN ID
                                     INT8U* ext,
                                     INT32U* id );
 
+    void mcp2515_decode_id( const INT8U tbufdata[],                     // Convert CAN ID
+                                    INT8U* ext,
+                                    INT32U* id );
+
     void mcp2515_write_canMsg( const INT8U buffer_sidh_addr );          // Write CAN message
     void mcp2515_read_canMsg( const INT8U buffer_sidh_addr);            // Read CAN message
+    void mcp2515_read_rxbuf( const INT8U instr,                         // Read CAN message, one transaction
+                             CAN_FRAME *frame );
     INT8U mcp2515_getNextFreeTXBuf(INT8U *txbuf_n);                     // Find empty transmit buffer
+    INT8U mcp2515_getTxBuf(INT8U *txbuf_n);                             // Take free transmit buffer (0..2)
+    void mcp2515_load_txbuf(const INT8U txbuf_n);                       // Load transmit buffer and send
 
 /*
 *  CAN operator function
@@ -101,18 +149,30 @@ class MCP_CAN
 
     INT8U setMsg(INT32U id, INT8U ext, INT8U len, INT8U *pData);        // Set message
     INT8U clearMsg();                                                   // Clear all message to zero
-    INT8U readMsg();                                                    // Read message
+    INT8U readMsg(CAN_FRAME *frame);                                    // Read message
     INT8U sendMsg();                                                    // Send message
+    INT8U queueMsg(INT8U *txbuf_n);                                     // Send message, don't wait
 
 public:
     MCP_CAN(INT8U _CS);
     INT8U begin(INT8U idmodeset, INT8U speedset, INT8U clockset);       // Initilize controller prameters
     INT8U init_Mask(INT8U num, INT8U ext, INT32U ulData);               // Initilize Mask(s)
     INT8U init_Filt(INT8U num, INT8U ext, INT32U ulData);               // initilize Filter(s)
+    INT8U setFilterSet(const INT32U masks[2],                           // Set both Masks and all
+                       const INT32U filters[6], INT8U ext = 0);         // Filters at once
     INT8U setMode(INT8U opMode);                                        // Set operational mode
+    void setSPIClock(INT32U clock);                                     // Set SPI clock in Hz
     INT8U sendMsgBuf(INT32U id, INT8U ext, INT8U len, INT8U *buf);      // Send message to transmit buffer
+    INT8U sendMsgBufAsync(INT32U id, INT8U ext, INT8U len, INT8U *buf); // Send message, return after RTS
     INT8U readMsgBuf(INT32U *id, INT8U *len, INT8U *buf);               // Read message from receive buffer
+    INT8U readMsgBufs(CAN_FRAME frames[], INT8U max);                   // Read all waiting messages
     INT8U checkReceive(void);                                           // Check for received data
+    void enableRxInterrupt(INT8U intPin);                               // Receive to ring by INT pin
+    void handleInterrupt(void);                                         // Move frames to ring (ISR)
+    INT8U pop(CAN_FRAME &frame);                                        // Take frame from ring
+    INT16U getRxOverflow(void);                                         // Frames lost, ring was full
+    void getStats(CAN_STATS &stats);                                    // Sample errors and copy stats
+    void clearStats(void);                                              // Reset statistics
     INT8U checkError(void);                                             // Check for errors
 };
 
@@ -32,6 +32,10 @@
 #define INT32U unsigned long
 #endif
 
+#ifndef INT16U
+#define INT16U uint16_t
+#endif
+
 #ifndef INT8U
 #define INT8U byte
 #endif
@@ -39,14 +43,28 @@
 // if print debug information
 //#define DEBUG_MODE 1
 
+// if wait 250us after each register write (timing of older versions)
+//#define MCP_LEGACY_DELAY 1
+
 /*
  *   Begin mt
  */
 #define TIMEOUTVALUE    50
+#ifndef MCP_SPI_CLOCK
+#define MCP_SPI_CLOCK   10000000                                        /* max. of MCP2515, SPI.h takes */
+#endif                                                                  /* the fastest rate up to this  */
+#ifndef CAN_RX_RING
+#define CAN_RX_RING     4                                               /* frames, power of two <= 128  */
+#endif
+#if (CAN_RX_RING & (CAN_RX_RING - 1)) || CAN_RX_RING > 128
+#error CAN_RX_RING must be a power of two up to 128
+#endif
+#define MODE_TIMEOUT    10                                              /* ms to wait for a mode change */
 #define MCP_SIDH        0
 #define MCP_SIDL        1
 #define MCP_EID8        2
 #define MCP_EID0        3
+#define MCP_DLC         4
 
 #define MCP_TXB_EXIDE_M     0x08                                        /* In TXBnSIDL                  */
 #define MCP_DLC_MASK        0x0F                                        /* 4 LSBits                     */
@@ -72,11 +90,16 @@
 
 #define MCP_TXB_RTR_M       0x40                                        /* In TXBnDLC                   */
 #define MCP_RXB_IDE_M       0x08                                        /* In RXBnSIDL                  */
+#define MCP_RXB_SRR_M       0x10                                        /* In RXBnSIDL                  */
 #define MCP_RXB_RTR_M       0x40                                        /* In RXBnDLC                   */
 
 #define MCP_STAT_RXIF_MASK   (0x03)
 #define MCP_STAT_RX0IF       (1<<0)
 #define MCP_STAT_RX1IF       (1<<1)
+#define MCP_STAT_TX0REQ      (1<<2)
+#define MCP_STAT_TX1REQ      (1<<4)
+#define MCP_STAT_TX2REQ      (1<<6)
+#define MCP_STAT_TXREQ_MASK  (0x54)
 
 #define MCP_EFLG_RX1OVR     (1<<7)
 #define MCP_EFLG_RX0OVR     (1<<6)
@@ -391,8 +414,8 @@
 #define MCP_RXBUF_0 (MCP_RXB0SIDH)
 #define MCP_RXBUF_1 (MCP_RXB1SIDH)
 
-#define MCP2515_SELECT()   digitalWrite(MCPCS, LOW)
-#define MCP2515_UNSELECT() digitalWrite(MCPCS, HIGH)
+#define MCP2515_SELECT()   do { SPI.beginTransaction(m_spiSettings); digitalWrite(MCPCS, LOW); } while (0)
+#define MCP2515_UNSELECT() do { digitalWrite(MCPCS, HIGH); SPI.endTransaction(); } while (0)
 
 #define MCP2515_OK         (0)
 #define MCP2515_FAIL       (1)
@@ -38,4 +38,16 @@ void CTimeout::Reset(unsigned long timeoutMS)
 {
     m_timeout = timeoutMS;
     m_startTime = millis();
-}
+}
+
+unsigned long CTimeout::Remaining()
+{
+    unsigned long elapsed = millis() - m_startTime;
+
+    if (elapsed >= m_timeout)
+    {
+        return 0;
+    }
+
+    return m_timeout - elapsed;
+}
@@ -16,6 +16,8 @@ public:
 
     void Reset(unsigned long timeoutMS);
 
+    unsigned long Remaining();
+
 private:
     volatile static unsigned long s_currentTime;
 
@@ -23,4 +25,4 @@ private:
     unsigned long m_timeout;
 };
 
-#endif // #ifndef __H_TIMEOUT_
+#endif // #ifndef __H_TIMEOUT_